@@ -0,0 +1,272 @@
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <vector>
+
+// Set of board positions kept as a dense bitmap, row by row (row = y coordinate).
+// Every row starts at a word boundary, so a row can be scanned a whole word at a time.
+struct Bitboard {
+    using word_t = uint64_t;
+    static constexpr uint32_t WORD_BITS = 64;
+
+    uint16_t size_x = 0;
+    uint16_t size_y = 0;
+    uint32_t words_per_row = 0;
+    std::vector <word_t> words;
+    uint32_t count = 0;
+
+    Bitboard() {}
+
+    Bitboard(uint16_t size_x, uint16_t size_y) {
+        resize(size_x, size_y);
+    }
+
+    // Also removes every position from the board.
+    void resize(uint16_t new_size_x, uint16_t new_size_y) {
+        size_x = new_size_x;
+        size_y = new_size_y;
+        words_per_row = (size_x + WORD_BITS - 1) / WORD_BITS;
+        words.assign((size_t) words_per_row * size_y, 0);
+        count = 0;
+    }
+
+    bool test(uint16_t x, uint16_t y) const {
+        return (word_at(x, y) >> (x % WORD_BITS)) & 1;
+    }
+
+    // Returns true if the position wasn't on the board before.
+    bool set(uint16_t x, uint16_t y) {
+        word_t &word = word_at(x, y);
+        word_t mask = (word_t) 1 << (x % WORD_BITS);
+        if (word & mask)
+            return false;
+        word |= mask;
+        count++;
+        return true;
+    }
+
+    // Returns true if the position was on the board before.
+    bool reset(uint16_t x, uint16_t y) {
+        word_t &word = word_at(x, y);
+        word_t mask = (word_t) 1 << (x % WORD_BITS);
+        if (!(word & mask))
+            return false;
+        word &= ~mask;
+        count--;
+        return true;
+    }
+
+    template<typename P>
+    bool contains(const P &position) const {
+        return test(position.x, position.y);
+    }
+
+    template<typename P>
+    bool insert(const P &position) {
+        return set(position.x, position.y);
+    }
+
+    template<typename P>
+    bool erase(const P &position) {
+        return reset(position.x, position.y);
+    }
+
+    void clear() {
+        if (count > 0)
+            std::fill(words.begin(), words.end(), 0);
+        count = 0;
+    }
+
+    size_t size() const {
+        return count;
+    }
+
+    bool empty() const {
+        return count == 0;
+    }
+
+    // Smallest x in [from_x, to_x] set in row y, -1 if there's none.
+    int32_t find_first_in_row(uint16_t y, uint16_t from_x, uint16_t to_x) const {
+        if (from_x > to_x)
+            return -1;
+        const word_t *row = &words[(size_t) y * words_per_row];
+        uint32_t w = from_x / WORD_BITS;
+        uint32_t last_w = to_x / WORD_BITS;
+        word_t word = row[w] & (~(word_t) 0 << (from_x % WORD_BITS));
+        for (;;) {
+            if (w == last_w)
+                word &= mask_up_to(to_x % WORD_BITS);
+            if (word)
+                return (int32_t) (w * WORD_BITS + (uint32_t) std::countr_zero(word));
+            if (w == last_w)
+                return -1;
+            word = row[++w];
+        }
+    }
+
+    // Largest x in [from_x, to_x] set in row y, -1 if there's none.
+    int32_t find_last_in_row(uint16_t y, uint16_t from_x, uint16_t to_x) const {
+        if (from_x > to_x)
+            return -1;
+        const word_t *row = &words[(size_t) y * words_per_row];
+        uint32_t w = to_x / WORD_BITS;
+        uint32_t first_w = from_x / WORD_BITS;
+        word_t word = row[w] & mask_up_to(to_x % WORD_BITS);
+        for (;;) {
+            if (w == first_w)
+                word &= ~(word_t) 0 << (from_x % WORD_BITS);
+            if (word)
+                return (int32_t) (w * WORD_BITS + WORD_BITS - 1 - (uint32_t) std::countl_zero(word));
+            if (w == first_w)
+                return -1;
+            word = row[--w];
+        }
+    }
+
+    // Calls function(x, y) for every position on the board, row by row, skipping empty words.
+    template<typename F>
+    void for_each(F &&function) const {
+        if (count == 0)
+            return;
+        for (uint32_t y = 0; y < size_y; ++y) {
+            for (uint32_t w = 0; w < words_per_row; ++w) {
+                word_t word = words[(size_t) y * words_per_row + w];
+                while (word) {
+                    uint32_t bit = (uint32_t) std::countr_zero(word);
+                    function((uint16_t) (w * WORD_BITS + bit), (uint16_t) y);
+                    word &= word - 1;
+                }
+            }
+        }
+    }
+
+private:
+    // Bits 0..bit set.
+    static word_t mask_up_to(uint32_t bit) {
+        return bit + 1 == WORD_BITS ? ~(word_t) 0 : ((word_t) 1 << (bit + 1)) - 1;
+    }
+
+    word_t &word_at(uint16_t x, uint16_t y) {
+        return words[(size_t) y * words_per_row + x / WORD_BITS];
+    }
+
+    const word_t &word_at(uint16_t x, uint16_t y) const {
+        return words[(size_t) y * words_per_row + x / WORD_BITS];
+    }
+};
+
+// Cells covered by an explosion: a cross made of a part of row y and a part of column x.
+struct Explosion {
+    uint16_t x;
+    uint16_t y;
+    uint16_t min_x;
+    uint16_t max_x;
+    uint16_t min_y;
+    uint16_t max_y;
+
+    bool contains(uint16_t cell_x, uint16_t cell_y) const {
+        return (cell_y == y && min_x <= cell_x && cell_x <= max_x) ||
+               (cell_x == x && min_y <= cell_y && cell_y <= max_y);
+    }
+
+    template<typename P>
+    bool contains(const P &position) const {
+        return contains(position.x, position.y);
+    }
+
+    // Calls function(x, y) for every cell of the explosion exactly once.
+    template<typename F>
+    void for_each(F &&function) const {
+        for (uint32_t i = min_x; i <= max_x; ++i)
+            function((uint16_t) i, y);
+        for (uint32_t i = min_y; i <= max_y; ++i) {
+            if (i != y)
+                function(x, (uint16_t) i);
+        }
+    }
+};
+
+// Blocks on the board. Besides the rows there's a transposed copy kept in sync, so that
+// both rows and columns can be scanned a whole word at a time.
+struct BlockBoard {
+    Bitboard rows;
+    Bitboard columns;
+
+    void resize(uint16_t size_x, uint16_t size_y) {
+        rows.resize(size_x, size_y);
+        columns.resize(size_y, size_x);
+    }
+
+    bool test(uint16_t x, uint16_t y) const {
+        return rows.test(x, y);
+    }
+
+    bool set(uint16_t x, uint16_t y) {
+        columns.set(y, x);
+        return rows.set(x, y);
+    }
+
+    bool reset(uint16_t x, uint16_t y) {
+        columns.reset(y, x);
+        return rows.reset(x, y);
+    }
+
+    template<typename P>
+    bool contains(const P &position) const {
+        return test(position.x, position.y);
+    }
+
+    template<typename P>
+    bool insert(const P &position) {
+        return set(position.x, position.y);
+    }
+
+    template<typename P>
+    bool erase(const P &position) {
+        return reset(position.x, position.y);
+    }
+
+    void clear() {
+        rows.clear();
+        columns.clear();
+    }
+
+    size_t size() const {
+        return rows.size();
+    }
+
+    bool empty() const {
+        return rows.empty();
+    }
+
+    template<typename F>
+    void for_each(F &&function) const {
+        rows.for_each(function);
+    }
+
+    // Explosion of a bomb at (x, y). In every direction it reaches radius cells or the
+    // first block (inclusive), whichever is closer. A bomb lying on a block only destroys it.
+    Explosion explosion(uint16_t x, uint16_t y, uint16_t radius) const {
+        if (test(x, y))
+            return {x, y, x, x, y, y};
+        uint16_t right = (uint16_t) std::min<uint32_t>(x + radius, rows.size_x - 1u);
+        uint16_t left = (uint16_t) (x > radius ? x - radius : 0);
+        uint16_t up = (uint16_t) std::min<uint32_t>(y + radius, rows.size_y - 1u);
+        uint16_t down = (uint16_t) (y > radius ? y - radius : 0);
+        int32_t block;
+        if (x < right && (block = rows.find_first_in_row(y, (uint16_t) (x + 1), right)) >= 0)
+            right = (uint16_t) block;
+        if (left < x && (block = rows.find_last_in_row(y, left, (uint16_t) (x - 1))) >= 0)
+            left = (uint16_t) block;
+        if (y < up && (block = columns.find_first_in_row(x, (uint16_t) (y + 1), up)) >= 0)
+            up = (uint16_t) block;
+        if (down < y && (block = columns.find_last_in_row(x, down, (uint16_t) (y - 1))) >= 0)
+            down = (uint16_t) block;
+        return {x, y, left, right, down, up};
+    }
+
+    template<typename P>
+    Explosion explosion(const P &position, uint16_t radius) const {
+        return explosion(position.x, position.y, radius);
+    }
+};
@@ -0,0 +1,27 @@
+#include <cstdint>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+using score_t = uint32_t;
+using player_id_t = uint8_t;
+using coordinate_t = uint16_t;
+using bomb_id_t = uint32_t;
+
+struct Position;
+struct Player;
+struct Bomb;
+struct GameInfo;
+
+using PlayersMap = std::map<player_id_t, Player>;
+using PlayerPositionMap = std::map<player_id_t, Position>;
+using PlayerScoreMap = std::map<player_id_t, score_t>;
+using BombMap = std::map<bomb_id_t, Bomb>;
+
+namespace Message {
+    const uint8_t RECEIVE_JOIN_MESSAGE_CODE = 0;
+    const uint8_t RECEIVE_PLACE_BOMB_MESSAGE_CODE = 1;
+    const uint8_t RECEIVE_PLACE_BLOCK_MESSAGE_CODE = 2;
+    const uint8_t RECEIVE_MOVE_MESSAGE_CODE = 3;
+}
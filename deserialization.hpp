@@ -1,70 +1,75 @@
-#define PLACE_CORRECT_LENGTH 1
-#define MOVE_CORRECT_LENGTH 2
 #define MESSAGE_CODE_INDEX 0
 #define MOVE_DIRECTION_INDEX 1
 
 namespace Deserialization {
-    inline uint8_t get_gui_message_code() {
-        return (uint8_t) udp_shared_buffer[MESSAGE_CODE_INDEX];
-    }
+    // Last datagram received from the GUI.
+    struct GuiDatagram {
+        std::array<char, UDP_BUFFER_SIZE> data;
+        size_t size = 0;
 
-    inline uint8_t get_gui_move_message_direction() {
-        return (uint8_t) udp_shared_buffer[MOVE_DIRECTION_INDEX];
-    }
+        // Input without arguments as the GUI sends it: GuiPlaceBomb or GuiPlaceBlock.
+        static GuiDatagram of(uint8_t code) {
+            GuiDatagram datagram;
+            datagram.data[MESSAGE_CODE_INDEX] = (char) code;
+            datagram.size = 1;
+            return datagram;
+        }
 
-    inline bool gui_datagram_is_legit(size_t &read) {
-        if ((get_gui_message_code() == PLACE_BOMB_GUI_MESSAGE_CODE ||
-             get_gui_message_code() == PLACE_BLOCK_GUI_MESSAGE_CODE) &&
-            read == PLACE_CORRECT_LENGTH)
-            return true;
-        if (get_gui_message_code() == MOVE_GUI_MESSAGE_CODE && read == MOVE_CORRECT_LENGTH) {
-            if (get_gui_move_message_direction() == UP || get_gui_move_message_direction() == RIGHT
-                || get_gui_move_message_direction() == DOWN ||
-                get_gui_move_message_direction() == LEFT)
-                return true;
+        static GuiDatagram move(uint8_t direction) {
+            GuiDatagram datagram = of(Protocol::GuiMove::code);
+            datagram.data[MOVE_DIRECTION_INDEX] = (char) direction;
+            datagram.size = Protocol::GuiMove::min_size;
+            return datagram;
         }
-        return false;
-    }
 
-    boost::asio::awaitable<void> receive_n_bytes(size_t n, boost::asio::ip::tcp::socket *socket) {
-        size_t read = 0;
-        while (read < n)
-            read += co_await
-        socket->async_read_some(
-                boost::asio::buffer(shared_buffer + buffer_index + read, n - read),
-                boost::asio::use_awaitable);
-        co_return;
-    }
+        boost::asio::awaitable<void> receive(boost::asio::ip::udp::socket *socket) {
+            size = co_await
+            socket->async_receive(boost::asio::buffer(data), boost::asio::use_awaitable);
+            co_return;
+        }
 
+        uint8_t code() const {
+            return (uint8_t) data[MESSAGE_CODE_INDEX];
+        }
 
-    boost::asio::awaitable<void>
-    receive_udp_datagram(boost::asio::ip::udp::socket *socket, size_t &read) {
-        read = co_await
-        socket->async_receive(
-                boost::asio::buffer(udp_shared_buffer, UDP_BUFFER_SIZE),
-                boost::asio::use_awaitable);
-        co_return;
-    }
+        uint8_t direction() const {
+            return (uint8_t) data[MOVE_DIRECTION_INDEX];
+        }
 
+        bool is_legit() const {
+            if (size == 0)
+                return false;
+            if ((code() == Protocol::GuiPlaceBomb::code &&
+                 size == Protocol::GuiPlaceBomb::min_size) ||
+                (code() == Protocol::GuiPlaceBlock::code &&
+                 size == Protocol::GuiPlaceBlock::min_size))
+                return true;
+            if (code() == Protocol::GuiMove::code && size == Protocol::GuiMove::min_size) {
+                if (direction() == UP || direction() == RIGHT || direction() == DOWN ||
+                    direction() == LEFT)
+                    return true;
+            }
+            return false;
+        }
+    };
 
-    boost::asio::awaitable<void> react_to_gui_message(boost::asio::ip::tcp::socket *socket) {
-        uint8_t code = (uint8_t) udp_shared_buffer[MESSAGE_CODE_INDEX];
-        switch (code) {
-            case MOVE_GUI_MESSAGE_CODE: {
-                uint8_t direction = (uint8_t) udp_shared_buffer[MOVE_DIRECTION_INDEX];
+    boost::asio::awaitable<void> react_to_gui_message(boost::asio::ip::tcp::socket *socket,
+                                                      const GuiDatagram &datagram) {
+        switch (datagram.code()) {
+            case Protocol::GuiMove::code: {
+                uint8_t direction = datagram.direction();
                 if (direction == UP || direction == RIGHT || direction == DOWN ||
                     direction == LEFT) {
-                    co_await Serialization::send_message_to_server(socket, SEND_MOVE_CODE,
-                                                                   direction);
+                    co_await Serialization::send_to_server<Protocol::Move>(socket, direction);
                 }
                 break;
             }
-            case PLACE_BOMB_GUI_MESSAGE_CODE: {
-                co_await Serialization::send_message_to_server(socket, SEND_PLACE_BOMB_CODE);
+            case Protocol::GuiPlaceBomb::code: {
+                co_await Serialization::send_to_server<Protocol::PlaceBomb>(socket);
                 break;
             }
-            case PLACE_BLOCK_GUI_MESSAGE_CODE: {
-                co_await Serialization::send_message_to_server(socket, SEND_PLACE_BLOCK_CODE);
+            case Protocol::GuiPlaceBlock::code: {
+                co_await Serialization::send_to_server<Protocol::PlaceBlock>(socket);
                 break;
             }
             default : {
@@ -74,203 +79,242 @@ namespace Deserialization {
         co_return;
     }
 
-
-    boost::asio::awaitable<void>
-    deserialize(std::string &str, size_t length, boost::asio::ip::tcp::socket *socket) {
-        buffer_index = 0;
-        uint32_t starting_point = buffer_index;
-        co_await receive_n_bytes(length, socket);
-        for (buffer_index = starting_point; buffer_index < starting_point + length; buffer_index++)
-            str += shared_buffer[buffer_index];
-        buffer_index = 0;
-        co_return;
+    // Moves the reader past the body of a server message or of a Turn event with the given
+    // code, false if it hasn't fully arrived yet.
+    inline bool skip_message_body(uint8_t code, Reader &reader) {
+        switch (code) {
+            case Protocol::Hello::code:
+                return Protocol::Hello::skip_body(reader);
+            case Protocol::AcceptedPlayer::code:
+                return Protocol::AcceptedPlayer::skip_body(reader);
+            case Protocol::GameStarted::code:
+                return Protocol::GameStarted::skip_body(reader);
+            case Protocol::Snapshot::code:
+                return Protocol::Snapshot::skip_body(reader);
+            case Protocol::GameEnded::code:
+                return Protocol::GameEnded::skip_body(reader);
+            default:
+                throw std::runtime_error("Invalid message from server.");
+        }
     }
 
-    boost::asio::awaitable<void>
-    deserialize(uint32_t &number, boost::asio::ip::tcp::socket *socket) {
-        co_await receive_n_bytes(sizeof(number), socket);
-        memcpy(&number, shared_buffer + buffer_index, sizeof(number));
-        number = be32toh(number);
-        co_return;
+    inline bool skip_event_body(uint8_t code, Reader &reader) {
+        switch (code) {
+            case Protocol::BombPlaced::code:
+                return Protocol::BombPlaced::skip_body(reader);
+            case Protocol::BombExploded::code:
+                return Protocol::BombExploded::skip_body(reader);
+            case Protocol::PlayerMoved::code:
+                return Protocol::PlayerMoved::skip_body(reader);
+            case Protocol::BlockPlaced::code:
+                return Protocol::BlockPlaced::skip_body(reader);
+            default:
+                throw std::runtime_error("Invalid event from server.");
+        }
     }
 
-    boost::asio::awaitable<void>
-    deserialize(uint16_t &number, boost::asio::ip::tcp::socket *socket) {
-        co_await receive_n_bytes(sizeof(number), socket);
-        memcpy(&number, shared_buffer + buffer_index, sizeof(number));
-        number = be16toh(number);
-        co_return;
-    }
+    // Bytes received from the server. Every read takes as much as the kernel has, the messages
+    // are then decoded from memory and the client only waits on the socket when it runs dry.
+    // A message is only decoded once all of it has arrived, till then next() just checks how
+    // much of it there is.
+    struct ServerStream {
+        static constexpr size_t READ_SIZE = 64 * 1024;
 
-    boost::asio::awaitable<void>
-    deserialize(uint8_t &number, boost::asio::ip::tcp::socket *socket) {
-        co_await receive_n_bytes(sizeof(number), socket);
-        number = static_cast<uint8_t>(shared_buffer[buffer_index]);
-        co_return;
-    }
+        std::vector<char> data;
+        size_t begin = 0;
+        size_t end = 0;
+        // Bytes of the Turn at begin known to have arrived, whole events only, and the number
+        // of its events after them. Kept between reads, so a long Turn is gone through once.
+        size_t turn_checked = 0;
+        uint32_t turn_events_left = 0;
 
-    boost::asio::awaitable <Position> receive_position(boost::asio::ip::tcp::socket *socket) {
-        uint16_t x_value, y_value;
-        co_await deserialize(x_value, socket);
-        co_await deserialize(y_value, socket);
-        Position position(x_value, y_value);
-        co_return position;
+        boost::asio::awaitable<void> receive(boost::asio::ip::tcp::socket *socket) {
+            if (begin == end) {
+                begin = end = 0;
+            } else if (begin > 0) {
+                // Początek niepełnej wiadomości na początek bufora.
+                memmove(data.data(), data.data() + begin, end - begin);
+                end -= begin;
+                begin = 0;
+            }
+            // A long message gets at least as much room as has already arrived of it,
+            // so it doesn't come in lots of small reads.
+            size_t wanted = end + std::max(READ_SIZE, end);
+            if (data.size() < wanted)
+                data.resize(wanted);
+            end += co_await socket->async_read_some(
+                    boost::asio::buffer(data.data() + end, data.size() - end),
+                    boost::asio::use_awaitable);
+        }
+
+        // Reader over exactly the next message, nullopt if it hasn't fully arrived yet.
+        std::optional <Reader> next() {
+            Reader reader(data.data() + begin, end - begin);
+            if (turn_checked == 0) {
+                if (!reader.has(1))
+                    return std::nullopt;
+                uint8_t code = reader.u8();
+                if (code != Protocol::TurnHeader::code) {
+                    if (!skip_message_body(code, reader))
+                        return std::nullopt;
+                    return Reader(reader.data, reader.index);
+                }
+                if (!reader.has(Protocol::TurnHeader::min_size - 1))
+                    return std::nullopt;
+                reader.u16();
+                turn_events_left = reader.u32();
+                turn_checked = reader.index;
+            }
+            reader.index = turn_checked;
+            while (turn_events_left > 0) {
+                if (!reader.has(1) || !skip_event_body(reader.u8(), reader))
+                    return std::nullopt;
+                turn_checked = reader.index;
+                turn_events_left--;
+            }
+            turn_checked = 0;
+            return Reader(reader.data, reader.index);
+        }
+
+        void consume(Reader &reader) {
+            begin += reader.index;
+        }
+    };
+
+    inline Position to_position(Protocol::Point point) {
+        return Position(point.x, point.y);
     }
 
-    boost::asio::awaitable <Message::HelloMessage>
-    receive_hello_message(boost::asio::ip::tcp::socket *socket) {
+    inline Message::HelloMessage receive_hello_message(Reader &reader) {
+        auto [server_name, players_count, size_x, size_y, game_length, explosion_radius,
+                bomb_timer] = Protocol::Hello::read_body(reader);
         Message::HelloMessage message;
-        uint8_t server_name_length;
-        co_await deserialize(server_name_length, socket);
-        co_await deserialize(message.server_name, (size_t) server_name_length, socket);
-        co_await deserialize(message.players_count, socket);
-        co_await deserialize(message.size_x, socket);
-        co_await deserialize(message.size_y, socket);
-        co_await deserialize(message.game_length, socket);
-        co_await deserialize(message.explosion_radius, socket);
-        co_await deserialize(message.bomb_timer, socket);
-        co_return message;
+        message.server_name = server_name;
+        message.players_count = players_count;
+        message.size_x = size_x;
+        message.size_y = size_y;
+        message.game_length = game_length;
+        message.explosion_radius = explosion_radius;
+        message.bomb_timer = bomb_timer;
+        return message;
     }
 
-    boost::asio::awaitable <Message::AcceptedPlayerMessage>
-    receive_accepted_player_message(boost::asio::ip::tcp::socket *socket) {
+    inline Message::AcceptedPlayerMessage receive_accepted_player_message(Reader &reader) {
+        auto [id, name, address] = Protocol::AcceptedPlayer::read_body(reader);
         Message::AcceptedPlayerMessage message;
-        co_await deserialize(message.id, socket);
-        uint8_t length_str;
-        co_await deserialize(length_str, socket);
-        co_await deserialize(message.player.name, (size_t) length_str, socket);
-        co_await deserialize(length_str, socket);
-        co_await deserialize(message.player.address, (size_t) length_str, socket);
-        co_return message;
+        message.id = id;
+        message.player.name = name;
+        message.player.address = address;
+        return message;
     }
 
-    boost::asio::awaitable <Message::GameStartedMessage>
-    receive_game_started_message(boost::asio::ip::tcp::socket *socket) {
+    inline Message::GameStartedMessage receive_game_started_message(Reader &reader) {
+        auto [players] = Protocol::GameStarted::read_body(reader);
         Message::GameStartedMessage message;
-        uint32_t size;
-        co_await deserialize(size, socket);
-        for (uint32_t i = 0; i < size; ++i) {
-            uint8_t id, length_name, length_address;
-            Player p;
-            co_await deserialize(id, socket);
-            co_await deserialize(length_name, socket);
-            co_await deserialize(p.name, (size_t) length_name, socket);
-            co_await deserialize(length_address, socket);
-            co_await deserialize(p.address, (size_t) length_address, socket);
-            message.players[id] = p;
-        }
-        co_return message;
+        players.for_each([&message](auto player) {
+            auto [id, name, address] = player;
+            message.players[id] = Player{std::string(name), std::string(address)};
+        });
+        return message;
     }
 
-    boost::asio::awaitable<void>
-    receive_bomb_placed(Message::TurnMessage &message, boost::asio::ip::tcp::socket *socket) {
-        uint32_t bomb_id;
-        co_await deserialize(bomb_id, socket);
-        Position
-        position = co_await
-        receive_position(socket);
-        Event::BombPlaced event(bomb_id, position);
-        message.other_events.push_back(std::make_shared<Event::BombPlaced>(event));
-        co_return;
+    inline void receive_bomb_placed(Message::TurnMessage &message, Reader &reader) {
+        auto [bomb_id, position] = Protocol::BombPlaced::read_body(reader);
+        message.other_events.push_back(
+                std::make_shared<Event::BombPlaced>(bomb_id, to_position(position)));
     }
 
-    boost::asio::awaitable<void>
-    receive_bomb_exploded(Message::TurnMessage &message, boost::asio::ip::tcp::socket *socket) {
-        uint32_t bomb_id, robots_destroyed_length, blocks_destroyed_length;
-        co_await deserialize(bomb_id, socket);
+    inline void receive_bomb_exploded(Message::TurnMessage &message, Reader &reader) {
+        auto [bomb_id, robots, blocks] = Protocol::BombExploded::read_body(reader);
         std::vector <player_id_t> robots_destroyed;
         std::vector <Position> blocks_destroyed;
-        co_await deserialize(robots_destroyed_length, socket);
-        for (uint32_t i = 0; i < robots_destroyed_length; ++i) {
-            player_id_t id;
-            co_await deserialize(id, socket);
+        robots_destroyed.reserve(robots.size());
+        robots.for_each([&robots_destroyed](player_id_t id) {
             robots_destroyed.push_back(id);
-        }
-        co_await deserialize(blocks_destroyed_length, socket);
-        for (uint32_t i = 0; i < blocks_destroyed_length; ++i) {
-            Position
-            position = co_await
-            receive_position(socket);
-            blocks_destroyed.push_back(position);
-        }
-        Event::BombExploded event(bomb_id, robots_destroyed, blocks_destroyed);
-        message.explosions.push_back(std::make_shared<Event::BombExploded>(event));
-        co_return;
+        });
+        blocks_destroyed.reserve(blocks.size());
+        blocks.for_each([&blocks_destroyed](Protocol::Point point) {
+            blocks_destroyed.push_back(to_position(point));
+        });
+        message.explosions.push_back(std::make_shared<Event::BombExploded>(
+                bomb_id, robots_destroyed, blocks_destroyed));
     }
 
-    boost::asio::awaitable<void>
-    receive_player_moved(Message::TurnMessage &message, boost::asio::ip::tcp::socket *socket) {
-        player_id_t player_id;
-        co_await deserialize(player_id, socket);
-        Position
-        position = co_await
-        receive_position(socket);
-        Event::PlayerMoved event(player_id, position);
-        message.other_events.push_back(std::make_shared<Event::PlayerMoved>(event));
-        co_return;
+    inline void receive_player_moved(Message::TurnMessage &message, Reader &reader) {
+        auto [player_id, position] = Protocol::PlayerMoved::read_body(reader);
+        message.other_events.push_back(
+                std::make_shared<Event::PlayerMoved>(player_id, to_position(position)));
     }
 
-    boost::asio::awaitable<void>
-    receive_block_placed(Message::TurnMessage &message, boost::asio::ip::tcp::socket *socket) {
-        Position
-        position = co_await
-        receive_position(socket);
-        Event::BlockPlaced event(position);
-        message.other_events.push_back(std::make_shared<Event::BlockPlaced>(event));
-        co_return;
+    inline void receive_block_placed(Message::TurnMessage &message, Reader &reader) {
+        auto [position] = Protocol::BlockPlaced::read_body(reader);
+        message.other_events.push_back(std::make_shared<Event::BlockPlaced>(to_position(position)));
     }
 
-    boost::asio::awaitable<void>
-    receive_event(Message::TurnMessage &message, boost::asio::ip::tcp::socket *socket) {
-        uint8_t code;
-        co_await deserialize(code, socket);
+    inline void receive_event(Message::TurnMessage &message, Reader &reader) {
+        uint8_t code = reader.u8();
         switch (code) {
-            case BOMB_PLACED_EVENT_CODE: {
-                co_await receive_bomb_placed(message, socket);
+            case Protocol::BombPlaced::code: {
+                receive_bomb_placed(message, reader);
                 break;
             }
-            case BOMB_EXPLODED_EVENT_CODE: {
-                co_await receive_bomb_exploded(message, socket);
+            case Protocol::BombExploded::code: {
+                receive_bomb_exploded(message, reader);
                 break;
             }
-            case PLAYER_MOVED_EVENT_CODE: {
-                co_await receive_player_moved(message, socket);
+            case Protocol::PlayerMoved::code: {
+                receive_player_moved(message, reader);
                 break;
             }
-            case BLOCK_PLACED_EVENT_CODE: {
-                co_await receive_block_placed(message, socket);
+            case Protocol::BlockPlaced::code: {
+                receive_block_placed(message, reader);
                 break;
             }
             default: {
-                break;
+                throw std::runtime_error("Invalid event from server.");
             }
         }
-        co_return;
     }
 
-    boost::asio::awaitable <Message::TurnMessage>
-    receive_turn_message(boost::asio::ip::tcp::socket *socket) {
+    inline Message::TurnMessage receive_turn_message(Reader &reader) {
+        auto [turn, length] = Protocol::TurnHeader::read_body(reader);
         Message::TurnMessage message;
-        uint32_t length;
-        co_await deserialize(message.turn, socket);
-        co_await deserialize(length, socket);
+        message.turn = turn;
         for (uint32_t i = 0; i < length; ++i)
-            co_await receive_event(message, socket);
-        co_return message;
+            receive_event(message, reader);
+        return message;
+    }
+
+    inline Message::SnapshotMessage receive_snapshot_message(Reader &reader) {
+        auto [turn, positions, scores, blocks, bombs] = Protocol::Snapshot::read_body(reader);
+        Message::SnapshotMessage message;
+        message.turn = turn;
+        positions.for_each([&message](auto entry) {
+            auto [id, position] = entry;
+            message.player_positions[id] = to_position(position);
+        });
+        scores.for_each([&message](auto entry) {
+            auto [id, score] = entry;
+            message.scores[id] = score;
+        });
+        message.blocks.reserve(blocks.size());
+        blocks.for_each([&message](Protocol::Point point) {
+            message.blocks.push_back(to_position(point));
+        });
+        bombs.for_each([&message](auto entry) {
+            auto [id, position, timer] = entry;
+            message.bombs.insert(id, Bomb(to_position(position), (uint32_t) message.turn + timer));
+        });
+        return message;
     }
 
-    boost::asio::awaitable <Message::GameEndedMessage>
-    receive_game_ended_message(boost::asio::ip::tcp::socket *socket) {
+    inline Message::GameEndedMessage receive_game_ended_message(Reader &reader) {
+        auto [scores] = Protocol::GameEnded::read_body(reader);
         Message::GameEndedMessage message;
-        uint32_t size;
-        co_await deserialize(size, socket);
-        for (uint32_t i = 0; i < size; ++i) {
-            uint8_t id;
-            uint32_t score;
-            co_await deserialize(id, socket);
-            co_await deserialize(score, socket);
+        scores.for_each([&message](auto entry) {
+            auto [id, score] = entry;
             message.scores[id] = score;
-        }
-        co_return message;
+        });
+        return message;
     }
 }
@@ -1,43 +1,18 @@
+#include <algorithm>
+#include <array>
 #include <cstdint>
 #include <vector>
 #include <string>
+#include <optional>
+#include <utility>
 
-#define BUFFER_SIZE 4096
 #define UDP_BUFFER_SIZE 16
 
-uint32_t buffer_index = 0;
-char shared_buffer[BUFFER_SIZE];
-char udp_shared_buffer[UDP_BUFFER_SIZE];
-
 #define UP 0
 #define RIGHT 1
 #define DOWN 2
 #define LEFT 3
 
-#define LOBBY_MESSAGE_TO_GUI 0
-#define GAME_MESSAGE_TO_GUI 1
-
-#define HELLO_CODE 0
-#define ACCEPTED_PLAYER_CODE 1
-#define GAME_STARTED_CODE 2
-#define TURN_CODE 3
-#define GAME_ENDED_CODE 4
-
-#define BOMB_PLACED_EVENT_CODE 0
-#define BOMB_EXPLODED_EVENT_CODE 1
-#define PLAYER_MOVED_EVENT_CODE 2
-#define BLOCK_PLACED_EVENT_CODE 3
-
-#define PLACE_BOMB_GUI_MESSAGE_CODE 0
-#define PLACE_BLOCK_GUI_MESSAGE_CODE 1
-#define MOVE_GUI_MESSAGE_CODE 2
-
-#define SEND_JOIN_CODE 0
-#define SEND_PLACE_BOMB_CODE 1
-#define SEND_PLACE_BLOCK_CODE 2
-#define SEND_MOVE_CODE 3
-
-
 using score_t = uint32_t;
 using player_id_t = uint8_t;
 using coordinate_t = uint16_t;
@@ -47,9 +22,6 @@ using score_t = uint32_t;
 struct Player;
 struct GameInfo;
 struct Position;
-using PlayersMap = std::map<player_id_t, Player>;
-using ScoresMap = std::map<player_id_t, score_t>;
-using PositionsMap = std::map<player_id_t, Position>;
 
 struct Position {
     Position() {}
@@ -67,11 +39,159 @@ struct Position {
 struct Bomb {
     Bomb() {};
 
-    Bomb(const Position &position, uint16_t timer) : position(position), timer(timer) {};
+    Bomb(const Position &position, uint32_t explosion_turn) : position(position),
+                                                              explosion_turn(explosion_turn) {};
 
     Position position;
-    uint16_t timer;
+    // Number of the turn the bomb explodes in, the timer shown by the GUI is derived from it.
+    uint32_t explosion_turn;
+
+};
+
+// Ids of players, kept sorted. There are few enough of them for a plain array.
+struct PlayerSet {
+    std::vector <player_id_t> ids;
+
+    bool contains(player_id_t id) const {
+        return std::binary_search(ids.begin(), ids.end(), id);
+    }
+
+    // Returns true if the id wasn't in the set before.
+    bool insert(player_id_t id) {
+        auto place = std::lower_bound(ids.begin(), ids.end(), id);
+        if (place != ids.end() && *place == id)
+            return false;
+        ids.insert(place, id);
+        return true;
+    }
+
+    void clear() {
+        ids.clear();
+    }
+
+    size_t size() const {
+        return ids.size();
+    }
+
+    bool empty() const {
+        return ids.empty();
+    }
+
+    auto begin() const {
+        return ids.begin();
+    }
+
+    auto end() const {
+        return ids.end();
+    }
+};
+
+// A value for every player present, stored in an array indexed by the id. Iterated like the
+// map it replaces: in id order, as (id, value) pairs.
+template<typename T>
+struct PlayerArray {
+    std::array<T, 256> values{};
+    PlayerSet present;
+
+    struct iterator {
+        const player_id_t *id;
+        const T *values;
+
+        std::pair<player_id_t, const T &> operator*() const {
+            return {*id, values[*id]};
+        }
+
+        iterator &operator++() {
+            ++id;
+            return *this;
+        }
+
+        bool operator!=(const iterator &other) const {
+            return id != other.id;
+        }
+    };
+
+    bool contains(player_id_t id) const {
+        return present.contains(id);
+    }
+
+    // Adds the player with a default value if it isn't present.
+    T &operator[](player_id_t id) {
+        if (present.insert(id))
+            values[id] = T();
+        return values[id];
+    }
+
+    const T &at(player_id_t id) const {
+        return values[id];
+    }
+
+    void clear() {
+        present.clear();
+    }
+
+    size_t size() const {
+        return present.size();
+    }
+
+    iterator begin() const {
+        return {present.ids.data(), values.data()};
+    }
+
+    iterator end() const {
+        return {present.ids.data() + present.ids.size(), values.data()};
+    }
+};
+
+// Bombs sorted by id. The server numbers bombs in the order they're placed, so a new one
+// goes at the end and a lookup is a binary search over contiguous memory.
+struct BombList {
+    std::vector <std::pair<bomb_id_t, Bomb>> entries;
 
+    Bomb *find(bomb_id_t id) {
+        auto place = lower_bound(id);
+        return place != entries.end() && place->first == id ? &place->second : nullptr;
+    }
+
+    void insert(bomb_id_t id, const Bomb &bomb) {
+        if (entries.empty() || entries.back().first < id) {
+            entries.emplace_back(id, bomb);
+            return;
+        }
+        auto place = lower_bound(id);
+        if (place == entries.end() || place->first != id)
+            entries.emplace(place, id, bomb);
+    }
+
+    void erase(bomb_id_t id) {
+        auto place = lower_bound(id);
+        if (place != entries.end() && place->first == id)
+            entries.erase(place);
+    }
+
+    void clear() {
+        entries.clear();
+    }
+
+    size_t size() const {
+        return entries.size();
+    }
+
+    auto begin() const {
+        return entries.begin();
+    }
+
+    auto end() const {
+        return entries.end();
+    }
+
+private:
+    std::vector<std::pair<bomb_id_t, Bomb>>::iterator lower_bound(bomb_id_t id) {
+        return std::lower_bound(entries.begin(), entries.end(), id,
+                                [](const auto &entry, bomb_id_t key) {
+                                    return entry.first < key;
+                                });
+    }
 };
 
 namespace Event {
@@ -102,8 +222,8 @@ namespace Event {
         void update_game_info(GameInfo &game_info) override;
 
         void
-        update_game_info(GameInfo &game_info, std::set <player_id_t> &players_destroyed_this_turn,
-                         std::set <Position> &blocks_destroyed_this_turn);
+        update_game_info(GameInfo &game_info, PlayerSet &players_destroyed_this_turn,
+                         std::vector <Position> &blocks_destroyed_this_turn);
 
         void calc_explosion(GameInfo &game_info, uint16_t &x_axis, uint16_t &y_axis);
     };
@@ -130,8 +250,35 @@ namespace Event {
 struct Player {
     std::string name;
     std::string address;
+
+    // The server sends the address of the player's connection as it sees it, e.g.
+    // "[::ffff:127.0.0.1]:54976". IPv4 addresses mapped to IPv6 match the plain IPv4 ones.
+    bool connected_from(const boost::asio::ip::tcp::endpoint &endpoint) const {
+        size_t delimiter = address.find_last_of(':');
+        if (delimiter == std::string::npos)
+            return false;
+        std::string host = address.substr(0, delimiter);
+        if (host.size() >= 2 && host.front() == '[' && host.back() == ']')
+            host = host.substr(1, host.size() - 2);
+        boost::system::error_code error;
+        boost::asio::ip::address ip = boost::asio::ip::make_address(host, error);
+        if (error || address.substr(delimiter + 1) != std::to_string(endpoint.port()))
+            return false;
+        return unmapped(ip) == unmapped(endpoint.address());
+    }
+
+private:
+    static boost::asio::ip::address unmapped(const boost::asio::ip::address &ip) {
+        if (ip.is_v6() && ip.to_v6().is_v4_mapped())
+            return boost::asio::ip::make_address_v4(boost::asio::ip::v4_mapped, ip.to_v6());
+        return ip;
+    }
 };
 
+using PlayersArray = PlayerArray<Player>;
+using ScoresArray = PlayerArray<score_t>;
+using PositionsArray = PlayerArray<Position>;
+
 namespace Message {
     struct HelloMessage {
         std::string server_name;
@@ -149,26 +296,63 @@ namespace Message {
     };
 
     struct GameStartedMessage {
-        PlayersMap players;
+        PlayersArray players;
     };
 
     struct GameEndedMessage {
-        ScoresMap scores;
+        ScoresArray scores;
+    };
+
+    // Game state after the given turn, sent to late joiners instead of the turns before it.
+    struct SnapshotMessage {
+        uint16_t turn;
+        PositionsArray player_positions;
+        ScoresArray scores;
+        std::vector <Position> blocks;
+        BombList bombs;
     };
 
     struct TurnMessage {
         uint16_t turn;
         std::vector <std::shared_ptr<Event::BombExploded>> explosions;
         std::vector <std::shared_ptr<Event::EventS>> other_events;
-        std::set <player_id_t> robots_destroyed_this_turn;
-        std::set <Position> blocks_destroyed_this_turn;
+        PlayerSet robots_destroyed_this_turn;
+        // May repeat a block hit by several bombs.
+        std::vector <Position> blocks_destroyed_this_turn;
     };
 }
 
+// What changed since the last datagram to the GUI, recorded while applying server messages.
+struct GuiDelta {
+    // Turn of the game state the GUI was last sent, none if it doesn't have one of this game.
+    std::optional <uint16_t> base_turn;
+    uint16_t keyframe_turn = 0;
+    PlayerSet moved;
+    std::vector <Position> blocks_removed;
+    std::vector <Position> blocks_added;
+    std::vector <Position> bombs_removed;
+    std::vector <bomb_id_t> bombs_added;
+    PlayerSet scores_changed;
+
+    void clear_changes() {
+        moved.clear();
+        blocks_removed.clear();
+        blocks_added.clear();
+        bombs_removed.clear();
+        bombs_added.clear();
+        scores_changed.clear();
+    }
+};
+
 struct GameInfo {
     bool in_lobby;
     bool join_sent;
     std::string my_player_name;
+    // Local end of the connection to the server.
+    boost::asio::ip::tcp::endpoint my_endpoint;
+    // Id of the player joined from our connection, or if the server's view of the address
+    // doesn't match ours (e.g. behind NAT) of the first player with our name. None if neither.
+    std::optional <player_id_t> my_id;
     std::string server_name;
     uint8_t players_count;
     coordinate_t size_x;
@@ -176,13 +360,38 @@ struct GameInfo {
     uint16_t game_length;
     uint16_t explosion_radius;
     uint16_t bomb_timer;
-    PlayersMap players;
-    PositionsMap player_positions;
-    std::set <Position> blocks;
-    std::map <uint32_t, Bomb> bombs;
-    std::set <Position> explosions;
-    ScoresMap scores;
+    PlayersArray players;
+    PositionsArray player_positions;
+    BlockBoard blocks;
+    BombList bombs;
+    Bitboard explosions;
+    ScoresArray scores;
     uint16_t turn;
+    // 0 - the GUI always gets the whole state. Otherwise only changes, with the whole state
+    // every that many turns, so a GUI that lost a datagram catches up.
+    uint16_t gui_keyframe_interval = 0;
+    GuiDelta gui_delta;
+    // Largest datagram sent to the GUI, longer messages go in chunks.
+    size_t gui_max_datagram = 65507;
+    uint32_t gui_messages_sent = 0;
+
+    bool gui_needs_keyframe() const {
+        return gui_keyframe_interval == 0 || !gui_delta.base_turn ||
+               turn - gui_delta.keyframe_turn >= gui_keyframe_interval;
+    }
+
+    void gui_game_state_sent(bool keyframe) {
+        if (keyframe)
+            gui_delta.keyframe_turn = turn;
+        gui_delta.base_turn = turn;
+        gui_delta.clear_changes();
+    }
+
+    // Lobby, or no datagram at all.
+    void gui_game_state_dropped() {
+        gui_delta.base_turn.reset();
+        gui_delta.clear_changes();
+    }
 
     void update_with_hello_info(Message::HelloMessage &message) {
         in_lobby = true;
@@ -194,6 +403,8 @@ struct GameInfo {
         game_length = message.game_length;
         explosion_radius = message.explosion_radius;
         bomb_timer = message.bomb_timer;
+        blocks.resize(size_x, size_y);
+        explosions.resize(size_x, size_y);
     }
 
     void update_with_accepted_player_info(Message::AcceptedPlayerMessage &message) {
@@ -204,14 +415,31 @@ struct GameInfo {
         players = message.players;
         turn = 0;
         in_lobby = false;
+        gui_game_state_dropped();
+        my_id.reset();
+        for (auto [id, player]: players) {
+            if (player.connected_from(my_endpoint)) {
+                my_id = id;
+                break;
+            }
+        }
+        if (!my_id) {
+            for (auto [id, player]: players) {
+                if (player.name == my_player_name) {
+                    my_id = id;
+                    break;
+                }
+            }
+        }
 
-        for (auto &player: players)
-            scores[player.first] = 0;
+        for (player_id_t id: players.present)
+            scores[id] = 0;
     }
 
     void update_with_game_ended_info() {
         in_lobby = true;
         join_sent = false;
+        my_id.reset();
         players.clear();
         blocks.clear();
         bombs.clear();
@@ -219,21 +447,34 @@ struct GameInfo {
         player_positions.clear();
     }
 
-    void update_with_turn_info(Message::TurnMessage &message) {
+    void update_with_snapshot_info(Message::SnapshotMessage &message) {
         turn = message.turn;
+        player_positions = std::move(message.player_positions);
+        scores = std::move(message.scores);
+        blocks.clear();
+        for (auto &position: message.blocks)
+            blocks.insert(position);
+        bombs = std::move(message.bombs);
+        explosions.clear();
+        gui_game_state_dropped();
+    }
 
-        for (auto &bomb: bombs)
-            bomb.second.timer--;
+    void update_with_turn_info(Message::TurnMessage &message) {
+        turn = message.turn;
 
         for (auto &event: message.explosions)
             event->update_game_info(*this, message.robots_destroyed_this_turn,
                                     message.blocks_destroyed_this_turn);
 
-        for (auto &destroyed_block_position: message.blocks_destroyed_this_turn)
-            this->blocks.erase(destroyed_block_position);
+        for (auto &destroyed_block_position: message.blocks_destroyed_this_turn) {
+            if (this->blocks.erase(destroyed_block_position))
+                gui_delta.blocks_removed.push_back(destroyed_block_position);
+        }
 
-        for (auto &destroyed_robot_id: message.robots_destroyed_this_turn)
+        for (auto &destroyed_robot_id: message.robots_destroyed_this_turn) {
             this->scores[destroyed_robot_id]++;
+            gui_delta.scores_changed.insert(destroyed_robot_id);
+        }
 
         for (auto &event: message.other_events)
             event->update_game_info(*this);
@@ -243,46 +484,26 @@ struct GameInfo {
 //GameInfo global_game_info;
 
 void Event::BlockPlaced::update_game_info(GameInfo &game_info) {
-    game_info.blocks.insert(this->position);
+    if (game_info.blocks.insert(this->position))
+        game_info.gui_delta.blocks_added.push_back(this->position);
 }
 
 void Event::PlayerMoved::update_game_info(GameInfo &game_info) {
     game_info.player_positions[this->id] = this->position;
+    game_info.gui_delta.moved.insert(this->id);
 }
 
 void Event::BombPlaced::update_game_info(GameInfo &game_info) {
-    game_info.bombs.insert({this->id, Bomb(this->position, game_info.bomb_timer)});
+    game_info.bombs.insert(this->id, Bomb(this->position,
+                                          (uint32_t) game_info.turn + game_info.bomb_timer));
+    game_info.gui_delta.bombs_added.push_back(this->id);
 }
 
 void Event::BombExploded::calc_explosion(GameInfo &game_info, uint16_t &x_axis, uint16_t &y_axis) {
-    for (uint16_t i = y_axis;
-         i < y_axis + game_info.explosion_radius + 1 && i < game_info.size_y; ++i) {
-        if (game_info.blocks.contains({x_axis, y_axis})) {
-            game_info.explosions.insert({x_axis, y_axis});
-            return;
-        }
-        game_info.explosions.insert({x_axis, i});
-        if (game_info.blocks.contains({x_axis, i}))
-            break;
-    }
-    for (uint16_t i = y_axis - 1;
-         i > y_axis - game_info.explosion_radius - 1 && y_axis != 0; --i) {
-        game_info.explosions.insert({x_axis, i});
-        if (game_info.blocks.contains({x_axis, i}) || i == 0)
-            break;
-    }
-    for (uint16_t i = x_axis + 1;
-         i < x_axis + game_info.explosion_radius + 1 && i < game_info.size_x; ++i) {
-        game_info.explosions.insert({i, y_axis});
-        if (game_info.blocks.contains({i, y_axis}))
-            break;
-    }
-    for (uint16_t i = x_axis - 1;
-         i > x_axis - game_info.explosion_radius - 1 && x_axis != 0; --i) {
-        game_info.explosions.insert({i, y_axis});
-        if (game_info.blocks.contains({i, y_axis}) || i == 0)
-            break;
-    }
+    Explosion explosion = game_info.blocks.explosion(x_axis, y_axis, game_info.explosion_radius);
+    explosion.for_each([&game_info](coordinate_t x, coordinate_t y) {
+        game_info.explosions.set(x, y);
+    });
 }
 
 // It's empty, but it's required to override this function in order to save Event::EventS as a virtual base class.
@@ -292,23 +513,28 @@ void Event::BombExploded::update_game_info(GameInfo &game_info) {
 
 void
 Event::BombExploded::update_game_info(GameInfo &game_info,
-                                      std::set <player_id_t> &players_destroyed_this_turn,
-                                      std::set <Position> &blocks_destroyed_this_turn) {
-    this->calc_explosion(game_info, game_info.bombs[this->id].position.x,
-                         game_info.bombs[this->id].position.y);
-    game_info.bombs.erase(this->id);
-    for (auto &destroyed_block_position: this->blocks_destroyed) {
-        // Don't destroy the block yet, as it could change the look of the explosion and it's effects.
-        // Add the block to a list of block that will be destroyed at the very end.
-        if (!blocks_destroyed_this_turn.contains(destroyed_block_position)) {
-            blocks_destroyed_this_turn.insert(destroyed_block_position);
-        }
-    }
-
-    for (auto &destroyed_robot_id: this->robots_destroyed) {
-        // To avoid killing the same robot a couple of times during one turn.
-        if (!players_destroyed_this_turn.contains(destroyed_robot_id)) {
-            players_destroyed_this_turn.insert(destroyed_robot_id);
-        }
+                                      PlayerSet &players_destroyed_this_turn,
+                                      std::vector <Position> &blocks_destroyed_this_turn) {
+    Bomb *bomb = game_info.bombs.find(this->id);
+    if (bomb) {
+        this->calc_explosion(game_info, bomb->position.x, bomb->position.y);
+        // Bomba, której GUI jeszcze nie dostało, po prostu znika z listy dodanych.
+        std::vector <bomb_id_t> &bombs_added = game_info.gui_delta.bombs_added;
+        auto added = std::find(bombs_added.begin(), bombs_added.end(), this->id);
+        if (added != bombs_added.end())
+            bombs_added.erase(added);
+        else
+            game_info.gui_delta.bombs_removed.push_back(bomb->position);
+        game_info.bombs.erase(this->id);
     }
+    // Don't destroy the blocks yet, as it could change the look of the explosion and it's effects.
+    // Add them to the blocks that will be destroyed at the very end, a block already there is
+    // just destroyed once.
+    blocks_destroyed_this_turn.insert(blocks_destroyed_this_turn.end(),
+                                      this->blocks_destroyed.begin(),
+                                      this->blocks_destroyed.end());
+
+    // To avoid killing the same robot a couple of times during one turn.
+    for (auto &destroyed_robot_id: this->robots_destroyed)
+        players_destroyed_this_turn.insert(destroyed_robot_id);
 }
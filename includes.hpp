@@ -50,22 +50,218 @@ struct RandomNumberGenerator {
 struct Bomb {
     Bomb() {}
 
-    Bomb(Position position, uint16_t timer) : position(position), timer(timer) {};
+    Bomb(Position position, uint32_t explosion_turn) : position(position),
+                                                       explosion_turn(explosion_turn) {};
     Position position;
-    uint16_t timer;
+    // numer tury, w której bomba wybuchnie
+    uint32_t explosion_turn;
 };
 
+// Serialized message, ready to be sent. It never changes once built, so one frame is shared
+// between all the recipients of the message and kept for clients joining later.
+struct Frame {
+    Frame(std::vector<char> &&bytes) : bytes(std::move(bytes)) {};
+
+    const std::vector<char> bytes;
+
+    boost::asio::const_buffer buffer() const {
+        return boost::asio::buffer(bytes);
+    }
+};
+
+using FramePtr = std::shared_ptr<const Frame>;
+
+// Zrzut stanu gry - pozycje, wyniki, bloki i bomby po rozegraniu danej tury.
+const uint8_t SNAPSHOT_MESSAGE_CODE = 5;
+
+// Gracze pogrupowani według wiersza i kolumny, w których stoją. Budowany na nowo w turach
+// z wybuchami, żeby sprawdzać tylko graczy stojących na linii wybuchu.
+struct PlayerOccupancy {
+    // by_row[y] - pary (x, id gracza), by_column[x] - pary (y, id gracza)
+    std::vector <std::vector<std::pair<uint16_t, player_id_t>>> by_row;
+    std::vector <std::vector<std::pair<uint16_t, player_id_t>>> by_column;
+    std::vector <uint16_t> used_rows;
+    std::vector <uint16_t> used_columns;
+
+    void resize(uint16_t size_x, uint16_t size_y) {
+        by_row.assign(size_y, {});
+        by_column.assign(size_x, {});
+        used_rows.clear();
+        used_columns.clear();
+    }
+
+    void clear() {
+        for (uint16_t y: used_rows)
+            by_row[y].clear();
+        for (uint16_t x: used_columns)
+            by_column[x].clear();
+        used_rows.clear();
+        used_columns.clear();
+    }
+
+    void build(PlayerPositionMap &player_positions) {
+        clear();
+        for (auto &player: player_positions) {
+            Position &position = player.second;
+            if (by_row[position.y].empty())
+                used_rows.push_back(position.y);
+            by_row[position.y].push_back({position.x, player.first});
+            if (by_column[position.x].empty())
+                used_columns.push_back(position.x);
+            by_column[position.x].push_back({position.y, player.first});
+        }
+    }
+
+    // Wywołuje function(id) dla każdego gracza stojącego w zasięgu wybuchu, raz dla gracza.
+    template<typename F>
+    void for_each_hit(const Explosion &explosion, F &&function) {
+        for (auto &[x, id]: by_row[explosion.y]) {
+            if (explosion.min_x <= x && x <= explosion.max_x)
+                function(id);
+        }
+        for (auto &[y, id]: by_column[explosion.x]) {
+            if (y != explosion.y && explosion.min_y <= y && y <= explosion.max_y)
+                function(id);
+        }
+    }
+};
+
+namespace Event {
+    struct BombPlaced {
+        BombPlaced() {}
+
+        BombPlaced(bomb_id_t id, Position position) : id(id), position(position) {};
+        bomb_id_t id;
+        Position position;
+
+        size_t encoded_size() const {
+            return Protocol::BombPlaced::size(id, position);
+        }
+
+        void get_serialized(Writer &writer) const {
+            Protocol::BombPlaced::write(writer, id, position);
+        }
+
+        void update_game_info(GameInfo &game_info) const;
+    };
+
+    struct PlayerMoved {
+        PlayerMoved() {}
+
+        PlayerMoved(player_id_t id, Position position) : id(id), position(position) {};
+
+        player_id_t id;
+        Position position;
+
+        size_t encoded_size() const {
+            return Protocol::PlayerMoved::size(id, position);
+        }
+
+        void get_serialized(Writer &writer) const {
+            Protocol::PlayerMoved::write(writer, id, position);
+        }
+
+        void update_game_info(GameInfo &game_info) const;
+    };
+
+    struct BombExploded {
+        bomb_id_t id;
+        std::vector <player_id_t> robots_destroyed;
+        std::vector <Position> blocks_destroyed;
+        Explosion explosion;
+
+        size_t encoded_size() const {
+            return Protocol::BombExploded::size(id, robots_destroyed, blocks_destroyed);
+        }
+
+        void get_serialized(Writer &writer) const {
+            Protocol::BombExploded::write(writer, id, robots_destroyed, blocks_destroyed);
+        }
+
+        void update_game_info(GameInfo &game_info) const;
+
+        void calc_explosion(GameInfo &game_info, Bomb &bomb);
+
+        // Wybuch zatrzymuje się na pierwszym bloku w każdym kierunku,
+        // więc zniszczone bloki mogą leżeć tylko na końcach wybuchu.
+        void create_blocks_destroyed_list(BlockBoard &block_positions) {
+            Position ends[] = {{explosion.min_x, explosion.y}, {explosion.max_x, explosion.y},
+                               {explosion.x, explosion.min_y}, {explosion.x, explosion.max_y}};
+            std::sort(std::begin(ends), std::end(ends));
+            for (size_t i = 0; i < std::size(ends); ++i) {
+                if ((i == 0 || ends[i - 1] < ends[i]) && block_positions.contains(ends[i]))
+                    blocks_destroyed.push_back(ends[i]);
+            }
+        }
+
+        void create_robots_destroyed_list(PlayerOccupancy &player_occupancy) {
+            player_occupancy.for_each_hit(explosion, [this](player_id_t id) {
+                robots_destroyed.push_back(id);
+            });
+            std::sort(robots_destroyed.begin(), robots_destroyed.end());
+        }
+    };
+
+    struct BlockPlaced {
+        BlockPlaced() {}
+
+        BlockPlaced(Position position) : position(position) {};
+        Position position;
+
+        size_t encoded_size() const {
+            return Protocol::BlockPlaced::size(position);
+        }
+
+        void get_serialized(Writer &writer) const {
+            Protocol::BlockPlaced::write(writer, position);
+        }
+
+        void update_game_info(GameInfo &game_info) const;
+    };
+}
+
+using EventVariant = std::variant<Event::BombPlaced, Event::BombExploded, Event::PlayerMoved,
+        Event::BlockPlaced>;
+
 struct Turn {
-    // lista eventów
-    Turn() {}
+    static constexpr uint32_t NO_EVENT = UINT32_MAX;
+
+    Turn() {
+        player_event_index.fill(NO_EVENT);
+    }
+
+    Turn(uint16_t nr) : nr(nr) {
+        player_event_index.fill(NO_EVENT);
+    };
 
-    Turn(uint16_t nr) : nr(nr) {};
     uint16_t nr;
-    uint32_t explosions_count = 0;
-    std::map <uint32_t, std::shared_ptr<Event::EventS>> events;
-    std::map <uint32_t, std::shared_ptr<Event::BombExploded>> explosions;
-};
+    // Wybuchy są wysyłane i rozgrywane przed pozostałymi zdarzeniami.
+    std::vector <EventVariant> explosions;
+    std::vector <EventVariant> events;
+    // Indeks w events zdarzenia danego gracza, kolejny ruch gracza w tej samej turze
+    // nadpisuje poprzedni.
+    std::array<uint32_t, 256> player_event_index;
+    // Tura w postaci gotowej do wysłania, ustawiana po rozegraniu tury.
+    FramePtr frame;
+
+    void add_event(EventVariant event) {
+        events.push_back(std::move(event));
+    }
 
+    void set_player_event(player_id_t player_id, EventVariant event) {
+        uint32_t &index = player_event_index[player_id];
+        if (index == NO_EVENT) {
+            index = (uint32_t) events.size();
+            events.push_back(std::move(event));
+        } else {
+            events[index] = std::move(event);
+        }
+    }
+
+    size_t events_count() const {
+        return explosions.size() + events.size();
+    }
+};
 
 struct GameInfo {
     bool is_running;
@@ -89,14 +285,26 @@ struct GameInfo {
     // lista wszystkich tur od początku rozgrywki
     std::vector <Turn> turn_working_list;
     std::vector <Turn> turn_official_list;
+    // komunikaty, które dostaje każdy nowo podłączony klient
+    FramePtr hello_frame;
+    FramePtr game_started_frame;
+    std::vector <FramePtr> accepted_player_frames;
+    // ostatni zrzut stanu gry i indeks w turn_official_list pierwszej tury po nim
+    uint16_t snapshot_interval;
+    FramePtr snapshot_frame;
+    size_t snapshot_next_turn_index = 0;
     // pozycje graczy
     PlayerPositionMap player_position_map;
+    // gracze według wierszy i kolumn planszy
+    PlayerOccupancy player_occupancy;
     // liczba śmierci każdego gracza
     PlayerScoreMap player_score_map;
     // informacje o istniejących bombach (pozycja, czas)
     BombMap bomb_map;
+    // identyfikatory bomb pogrupowane według tury wybuchu, w pierścieniu długości bomb_timer + 1
+    std::vector <std::vector<bomb_id_t>> bomb_wheel;
     // pozycje istniejących bloków
-    std::set <Position> block_position_set;
+    BlockBoard blocks;
     uint16_t initial_blocks;
     uint32_t total_bomb_placed_count;
 
@@ -106,189 +314,87 @@ struct GameInfo {
         just_accepted_player = false;
         players_count = program_params.players_count;
         bomb_timer = program_params.bomb_timer;
+        bomb_wheel.resize(bomb_timer + 1u);
         turn_duration = program_params.turn_duration;
         explosion_radius = program_params.explosion_radius;
         game_length = program_params.game_length;
         server_name = program_params.server_name;
         board_dimensions.size_x = program_params.size_x;
         board_dimensions.size_y = program_params.size_y;
+        blocks.resize(board_dimensions.size_x, board_dimensions.size_y);
+        player_occupancy.resize(board_dimensions.size_x, board_dimensions.size_y);
         seed = program_params.seed;
         initial_blocks = program_params.initial_blocks;
+        snapshot_interval = program_params.snapshot_interval;
         random_number_generator.last_number = seed;
         total_bomb_placed_count = 0;
+        current_turn = 0;
     }
 
     bool enough_clients_joined() {
         return (uint8_t) players.size() == players_count;
     }
 
-    bool last_turn_finished() {
-        return current_turn == game_length;
+    void schedule_bomb(bomb_id_t id, uint32_t explosion_turn) {
+        bomb_wheel[explosion_turn % bomb_wheel.size()].push_back(id);
     }
-};
-
-namespace Event {
-//    const uint8_t BOMB_PLACED_CODE = 0;
-//    const uint8_t BOMB_EXPLODED_CODE = 1;
-//    const uint8_t PLAYER_MOVED_CODE = 2;
-//    const uint8_t BLOCK_PLACED_CODE = 3;
-
-    struct EventS {
-        virtual void get_serialized(boost::asio::streambuf &streambuf) = 0;
-
-        virtual void update_game_info(GameInfo &game_info) = 0;
-    };
-
-    struct BombPlaced : EventS {
-        BombPlaced() {}
-
-        BombPlaced(bomb_id_t id, Position position) : id(id), position(position) {};
-        bomb_id_t id;
-        Position position;
-
-        void get_serialized(boost::asio::streambuf &streambuf) override {
-//            std::cout << "SER BO_PL\n";
-            Serialization::serialize(BOMB_PLACED_CODE, streambuf);
-            Serialization::serialize(id, streambuf);
-            Serialization::serialize(position, streambuf);
-        }
-
-        void update_game_info(GameInfo &game_info) override {
-            Bomb bomb(position, game_info.bomb_timer);
-            game_info.bomb_map[id] = bomb;
-        }
-
-    };
-
-    struct PlayerMoved : EventS {
-        PlayerMoved() {}
-
-        PlayerMoved(player_id_t id, Position position) : id(id), position(position) {};
-
-        player_id_t id;
-        Position position;
-
-        void get_serialized(boost::asio::streambuf &streambuf) override {
-//            std::cout << "SER PL_MV\n";
-            Serialization::serialize(PLAYER_MOVED_CODE, streambuf);
-            Serialization::serialize(id, streambuf);
-            Serialization::serialize(position, streambuf);
-        }
-
-        void update_game_info(GameInfo &game_info) override {
-            game_info.player_position_map[id] = position;
-        }
-    };
-
-    struct BombExploded : EventS {
-        bomb_id_t id;
-        std::vector <player_id_t> robots_destroyed;
-        std::vector <Position> blocks_destroyed;
-        std::set <Position> explosion_positions;
-
-        void get_serialized(boost::asio::streambuf &streambuf) override {
-//            std::cout << "SER BO_EX\n";
-            Serialization::serialize(BOMB_EXPLODED_CODE, streambuf);
-            Serialization::serialize(id, streambuf);
 
-            Serialization::serialize((uint32_t) robots_destroyed.size(), streambuf);
-            for (auto &robot_id: robots_destroyed)
-                Serialization::serialize(robot_id, streambuf);
+    std::vector <bomb_id_t> &bombs_exploding_in(uint32_t turn) {
+        return bomb_wheel[turn % bomb_wheel.size()];
+    }
 
-            Serialization::serialize((uint32_t) blocks_destroyed.size(), streambuf);
-            for (auto &block_position: blocks_destroyed)
-                Serialization::serialize(block_position, streambuf);
-        }
+    uint16_t bomb_timer_left(const Bomb &bomb) {
+        return (uint16_t) (bomb.explosion_turn - current_turn);
+    }
 
-        void update_game_info(GameInfo &game_info) override {
-            for (auto &player_id: robots_destroyed) {
-                game_info.player_score_map[player_id]++;
-                Position position((uint16_t) game_info.random_number_generator.generate() %
-                                  game_info.board_dimensions.size_x,
-                                  (uint16_t) game_info.random_number_generator.generate() %
-                                  game_info.board_dimensions.size_y);
-                game_info.player_position_map[player_id] = position;
-                Event::PlayerMoved moved_event;
-                moved_event.id = player_id;
-                moved_event.position = position;
-                game_info.turn_official_list.back().events[player_id] =
-                        std::make_shared<Event::PlayerMoved>(moved_event);
-            }
+    // Ruchy są przyjmowane dopiero od tury 1, tura 0 to rozstawienie planszy.
+    bool accepting_moves() {
+        return is_running && current_turn > 0;
+    }
 
-            for (auto &position: blocks_destroyed) {
-                game_info.block_position_set.erase(position);
-            }
+    bool last_turn_finished() {
+        return current_turn == game_length;
+    }
+};
 
-            game_info.bomb_map.erase(id);
-        }
 
-        void calc_explosion(GameInfo &game_info, Bomb &bomb) {
-            for (uint16_t i = bomb.position.y;
-                 i < bomb.position.y + game_info.explosion_radius + 1 &&
-                 i < game_info.board_dimensions.size_y; ++i) {
-                if (game_info.block_position_set.contains({bomb.position.x, bomb.position.y})) {
-                    explosion_positions.insert({bomb.position.x, bomb.position.y});
-                    return;
-                }
-                explosion_positions.insert({bomb.position.x, i});
-
-                if (game_info.block_position_set.contains({bomb.position.x, i}))
-                    break;
-            }
-            for (uint16_t i = bomb.position.y - 1;
-                 i > bomb.position.y - game_info.explosion_radius - 1 &&
-                 bomb.position.y != 0; --i) {
-                explosion_positions.insert({bomb.position.x, i});
-                if (game_info.block_position_set.contains({bomb.position.x, i}) || i == 0)
-                    break;
-            }
-            for (uint16_t i = bomb.position.x + 1;
-                 i < bomb.position.x + game_info.explosion_radius + 1 &&
-                 i < game_info.board_dimensions.size_x; ++i) {
-                explosion_positions.insert({i, bomb.position.y});
-                if (game_info.block_position_set.contains({i, bomb.position.y}))
-                    break;
-            }
-            for (uint16_t i = bomb.position.x - 1;
-                 i > bomb.position.x - game_info.explosion_radius - 1 &&
-                 bomb.position.x != 0; --i) {
-                explosion_positions.insert({i, bomb.position.y});
-                if (game_info.block_position_set.contains({i, bomb.position.y}) || i == 0)
-                    break;
-            }
-        }
+void Event::BombPlaced::update_game_info(GameInfo &game_info) const {
+    Bomb bomb(position, (uint32_t) game_info.current_turn + game_info.bomb_timer);
+    game_info.bomb_map[id] = bomb;
+    game_info.schedule_bomb(id, bomb.explosion_turn);
+}
 
-        void create_blocks_destroyed_list(std::set <Position> &block_positions) {
-            for (auto &position: explosion_positions) {
-                if (block_positions.contains(position))
-                    blocks_destroyed.push_back(position);
-            }
-        }
+void Event::PlayerMoved::update_game_info(GameInfo &game_info) const {
+    game_info.player_position_map[id] = position;
+}
 
-        void create_robots_destroyed_list(PlayerPositionMap &player_positions) {
-            for (auto &player: player_positions) {
-                if (explosion_positions.contains(player.second))
-                    robots_destroyed.push_back(player.first);
-            }
-        }
-    };
+void Event::BombExploded::update_game_info(GameInfo &game_info) const {
+    for (auto player_id: robots_destroyed) {
+        game_info.player_score_map[player_id]++;
+        Position position((uint16_t) game_info.random_number_generator.generate() %
+                          game_info.board_dimensions.size_x,
+                          (uint16_t) game_info.random_number_generator.generate() %
+                          game_info.board_dimensions.size_y);
+        game_info.player_position_map[player_id] = position;
+        // Zniszczony robot zamiast swojego ruchu pojawia się w nowym miejscu.
+        game_info.turn_official_list.back().set_player_event(player_id,
+                                                             Event::PlayerMoved(player_id,
+                                                                                position));
+    }
 
-    struct BlockPlaced : EventS {
-        BlockPlaced() {}
+    for (auto position: blocks_destroyed) {
+        game_info.blocks.erase(position);
+    }
 
-        BlockPlaced(Position position) : position(position) {};
-        Position position;
+    game_info.bomb_map.erase(id);
+}
 
-        void get_serialized(boost::asio::streambuf &streambuf) override {
-//            std::cout << "SER BL_PL\n";
-            Serialization::serialize(BLOCK_PLACED_CODE, streambuf);
-            Serialization::serialize(position, streambuf);
-        }
+void Event::BombExploded::calc_explosion(GameInfo &game_info, Bomb &bomb) {
+    explosion = game_info.blocks.explosion(bomb.position, game_info.explosion_radius);
+}
 
-        void update_game_info(GameInfo &game_info) override {
-            game_info.block_position_set.insert(position);
-        }
-    };
+void Event::BlockPlaced::update_game_info(GameInfo &game_info) const {
+    game_info.blocks.insert(position);
 }
 
 namespace Message {
@@ -343,13 +449,3 @@ namespace Message {
         }
     };
 }
-
-struct Buffer {
-//    const size_t MAX_BUFFER_SIZE = 4096;
-    char data[4096];
-    size_t index = 0;
-
-    uint8_t get_message_code() {
-        return data[0];
-    }
-};
@@ -32,14 +32,32 @@ namespace ProgramParams {
 
     struct ProgramParams {
         ProgramParams(std::string player_name, uint16_t port,
-                      AddressPair server_address, AddressPair gui_address) :
+                      AddressPair server_address, AddressPair gui_address, bool gui_delta,
+                      uint16_t gui_keyframe_interval, size_t gui_max_datagram,
+                      uint16_t sessions, uint16_t threads, bool headless, std::string policy,
+                      uint32_t seed) :
                 player_name(player_name), port(port), server_address(server_address),
-                gui_address(gui_address) {};
+                gui_address(gui_address), gui_delta(gui_delta),
+                gui_keyframe_interval(gui_keyframe_interval),
+                gui_max_datagram(gui_max_datagram), sessions(sessions), threads(threads),
+                headless(headless), policy(policy), seed(seed) {};
 
         std::string player_name;
         uint16_t port;
         AddressPair server_address;
         AddressPair gui_address;
+        // Send the GUI only changes, with the whole state every gui_keyframe_interval turns.
+        bool gui_delta;
+        uint16_t gui_keyframe_interval;
+        // E.g. 1452 to fit an Ethernet frame over IPv6, the default is the most UDP can carry.
+        size_t gui_max_datagram;
+        // Players played by this process, session i uses port + i and the GUI port + i.
+        uint16_t sessions;
+        uint16_t threads;
+        // No GUI, the inputs come from the policy, session i seeds it with seed + i.
+        bool headless;
+        std::string policy;
+        uint32_t seed;
     };
 
     AddressPair parse_server_address(
@@ -64,7 +82,25 @@ namespace ProgramParams {
                 ("player-name,n", boost::program_options::value<std::string>(), "player-name")
                 ("gui-address,d", boost::program_options::value<std::string>(), "gui-address")
                 ("server-address,s", boost::program_options::value<std::string>(),
-                 "server-address");
+                 "server-address")
+                ("gui-delta", boost::program_options::bool_switch(),
+                 "send the GUI only what changed since the previous datagram")
+                ("gui-keyframe-interval",
+                 boost::program_options::value<uint16_t>()->default_value(10),
+                 "turns between full states sent to the GUI in delta mode")
+                ("gui-max-datagram",
+                 boost::program_options::value<size_t>()->default_value(65507),
+                 "largest datagram sent to the GUI, longer messages are split into chunks")
+                ("sessions,c", boost::program_options::value<uint16_t>()->default_value(1),
+                 "number of players, each with its own connection and GUI ports")
+                ("threads,t", boost::program_options::value<uint16_t>()->default_value(1),
+                 "threads driving the sessions")
+                ("headless", boost::program_options::bool_switch(),
+                 "play without a GUI, with the inputs from the policy")
+                ("policy", boost::program_options::value<std::string>()->default_value("random"),
+                 "inputs in headless mode: random, dodger or script:FILE")
+                ("seed", boost::program_options::value<uint32_t>()->default_value(1),
+                 "seed of the policy of the first session");
 
         boost::program_options::variables_map vm;
         boost::program_options::store(boost::program_options::parse_command_line(argc, av, desc),
@@ -75,21 +111,31 @@ namespace ProgramParams {
             exit(0);
         }
 
-        if (!vm.count("port") || !vm.count("player-name") ||
-            !vm.count("server-address") || !vm.count("gui-address")) {
+        bool headless = vm["headless"].as<bool>();
+        if ((!headless && (!vm.count("port") || !vm.count("gui-address"))) ||
+            !vm.count("player-name") || !vm.count("server-address")) {
             std::cerr << "Wrong arguments provided\n";
             std::cerr << desc << "\n";
             exit(1);
         }
         AddressPair server_params =
                 parse_server_address(vm["server-address"].as<std::string>());
-        AddressPair gui_params =
-                parse_server_address(vm["gui-address"].as<std::string>());
+        AddressPair gui_params;
+        if (!headless)
+            gui_params = parse_server_address(vm["gui-address"].as<std::string>());
 
         ProgramParams program_params(vm["player-name"].as<std::string>(),
-                                     vm["port"].as<uint16_t>(),
+                                     headless ? 0 : vm["port"].as<uint16_t>(),
                                      server_params,
-                                     gui_params);
+                                     gui_params,
+                                     vm["gui-delta"].as<bool>(),
+                                     vm["gui-keyframe-interval"].as<uint16_t>(),
+                                     vm["gui-max-datagram"].as<size_t>(),
+                                     vm["sessions"].as<uint16_t>(),
+                                     vm["threads"].as<uint16_t>(),
+                                     headless,
+                                     vm["policy"].as<std::string>(),
+                                     vm["seed"].as<uint32_t>());
         return program_params;
     }
 }
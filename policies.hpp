@@ -0,0 +1,127 @@
+#include <fstream>
+#include <functional>
+#include <random>
+
+// Players for the headless client, standing in for the GUI. A policy is called after every
+// turn with the state decoded from the server and gives the input the GUI would have sent, if
+// any, so it goes to the server exactly the same way. Every session draws from its own
+// generator.
+namespace Policies {
+    using Input = Deserialization::GuiDatagram;
+    using Policy = std::function<std::optional<Input>(GameInfo &game_info)>;
+
+    // Each turn a move (70%), a bomb (15%), a block (5%) or nothing.
+    Policy random_policy(uint32_t seed, const std::string &) {
+        return [generator = std::minstd_rand(seed)](GameInfo &) mutable -> std::optional<Input> {
+            uint32_t roll = (uint32_t) (generator() % 20);
+            if (roll < 14)
+                return Input::move((uint8_t) (roll % 4));
+            if (roll < 17)
+                return Input::of(Protocol::GuiPlaceBomb::code);
+            if (roll < 18)
+                return Input::of(Protocol::GuiPlaceBlock::code);
+            return std::nullopt;
+        };
+    }
+
+    // Cell next to the position in the given direction, none at the edge of the board.
+    std::optional <Position> neighbour(GameInfo &game_info, Position position, uint8_t direction) {
+        if (direction == UP && position.y + 1 < game_info.size_y)
+            position.y++;
+        else if (direction == RIGHT && position.x + 1 < game_info.size_x)
+            position.x++;
+        else if (direction == DOWN && position.y > 0)
+            position.y--;
+        else if (direction == LEFT && position.x > 0)
+            position.x--;
+        else
+            return std::nullopt;
+        return position;
+    }
+
+    // Stays out of the reach of every bomb on the board. From a safe cell it wanders to safe
+    // cells only and now and then places a bomb, from a cell in reach it steps to a safe
+    // neighbour, or to any free one if there's none.
+    Policy dodger_policy(uint32_t seed, const std::string &) {
+        return [generator = std::minstd_rand(seed)](
+                GameInfo &game_info) mutable -> std::optional<Input> {
+            if (!game_info.my_id || !game_info.player_positions.contains(*game_info.my_id))
+                return std::nullopt;
+            Position position = game_info.player_positions.at(*game_info.my_id);
+            auto in_reach = [&game_info](Position cell) {
+                for (auto &[id, bomb]: game_info.bombs) {
+                    if (game_info.blocks.explosion(bomb.position, game_info.explosion_radius)
+                            .contains(cell))
+                        return true;
+                }
+                return false;
+            };
+            std::vector <uint8_t> safe;
+            std::vector <uint8_t> free;
+            for (uint8_t direction = 0; direction < 4; ++direction) {
+                std::optional <Position> cell = neighbour(game_info, position, direction);
+                if (!cell || game_info.blocks.contains(*cell))
+                    continue;
+                free.push_back(direction);
+                if (!in_reach(*cell))
+                    safe.push_back(direction);
+            }
+            uint32_t roll = (uint32_t) generator();
+            if (!in_reach(position) && roll % 10 == 0 && !safe.empty())
+                return Input::of(Protocol::GuiPlaceBomb::code);
+            std::vector <uint8_t> &moves = safe.empty() && in_reach(position) ? free : safe;
+            if (moves.empty())
+                return std::nullopt;
+            return Input::move(moves[roll / 10 % moves.size()]);
+        };
+    }
+
+    // Inputs from a file, one per turn and line, over and over: bomb, block, up, right, down,
+    // left, or - for nothing.
+    Policy script_policy(uint32_t, const std::string &file) {
+        std::ifstream in(file);
+        if (!in)
+            throw std::invalid_argument("cannot open script " + file);
+        std::vector <std::optional<Input>> inputs;
+        const std::vector <std::string> moves = {"up", "right", "down", "left"};
+        for (std::string line; std::getline(in, line);) {
+            if (line == "bomb") {
+                inputs.push_back(Input::of(Protocol::GuiPlaceBomb::code));
+            } else if (line == "block") {
+                inputs.push_back(Input::of(Protocol::GuiPlaceBlock::code));
+            } else if (line == "-") {
+                inputs.push_back(std::nullopt);
+            } else {
+                auto move = std::find(moves.begin(), moves.end(), line);
+                if (move == moves.end())
+                    throw std::invalid_argument("unknown input in " + file + ": " + line);
+                inputs.push_back(Input::move((uint8_t) (move - moves.begin())));
+            }
+        }
+        if (inputs.empty())
+            throw std::invalid_argument("empty script " + file);
+        return [inputs = std::move(inputs), next = (size_t) 0](GameInfo &) mutable {
+            std::optional <Input> input = inputs[next];
+            next = (next + 1) % inputs.size();
+            return input;
+        };
+    }
+
+    const std::vector <std::pair<std::string, Policy (*)(uint32_t, const std::string &)>>
+            policies = {
+            {"random", random_policy},
+            {"dodger", dodger_policy},
+            {"script", script_policy},
+    };
+
+    // NAME, or script:FILE.
+    Policy make_policy(const std::string &spec, uint32_t seed) {
+        std::string name = spec.substr(0, spec.find(':'));
+        std::string argument = name.size() < spec.size() ? spec.substr(name.size() + 1) : "";
+        for (auto &[policy_name, make]: policies) {
+            if (policy_name == name)
+                return make(seed, argument);
+        }
+        throw std::invalid_argument("unknown policy " + spec);
+    }
+}
@@ -0,0 +1,420 @@
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <string_view>
+#include <tuple>
+#include <utility>
+
+// Wire layout of every message, written down once. Encoders (with exact encoded sizes) and
+// decoders of the server, the client and the GUI protocol are all generated from it.
+//
+// A field kind knows its encoded size (min_size, exact if it's fixed), how to write a value
+// with a Writer, how to read one with a Reader and how to skip one. Decoding doesn't allocate:
+// strings come out as string_views and lists as views into the received bytes, valid as long as
+// those bytes are. Skipping decodes nothing and doesn't throw, it only tells whether the field
+// has fully arrived, so a message is decoded once all of it is there.
+namespace Protocol {
+    struct Point {
+        uint16_t x;
+        uint16_t y;
+    };
+
+    // Field of a constant encoded size. Reading it checks bounds once, then just loads.
+    template<typename Derived, size_t SIZE>
+    struct FixedField {
+        static constexpr bool fixed = true;
+        static constexpr size_t min_size = SIZE;
+
+        template<typename T>
+        static size_t size(const T &) {
+            return SIZE;
+        }
+
+        static auto read(Reader &reader) {
+            reader.need(SIZE);
+            auto value = Derived::load(reader.data + reader.index);
+            reader.index += SIZE;
+            return value;
+        }
+
+        static bool skip(Reader &reader) {
+            if (!reader.has(SIZE))
+                return false;
+            reader.index += SIZE;
+            return true;
+        }
+    };
+
+    struct U8 : FixedField<U8, 1> {
+        using value_type = uint8_t;
+
+        template<typename T>
+        static void write(Writer &writer, const T &value) {
+            writer.u8((uint8_t) value);
+        }
+
+        static value_type load(const char *data) {
+            return (uint8_t) data[0];
+        }
+    };
+
+    struct U16 : FixedField<U16, 2> {
+        using value_type = uint16_t;
+
+        template<typename T>
+        static void write(Writer &writer, const T &value) {
+            writer.u16((uint16_t) value);
+        }
+
+        static value_type load(const char *data) {
+            uint16_t number;
+            memcpy(&number, data, sizeof(number));
+            return be16toh(number);
+        }
+    };
+
+    struct U32 : FixedField<U32, 4> {
+        using value_type = uint32_t;
+
+        template<typename T>
+        static void write(Writer &writer, const T &value) {
+            writer.u32((uint32_t) value);
+        }
+
+        static value_type load(const char *data) {
+            uint32_t number;
+            memcpy(&number, data, sizeof(number));
+            return be32toh(number);
+        }
+    };
+
+    // Anything with x and y.
+    struct Pos : FixedField<Pos, 4> {
+        using value_type = Point;
+
+        template<typename P>
+        static void write(Writer &writer, const P &position) {
+            writer.u16(position.x);
+            writer.u16(position.y);
+        }
+
+        static value_type load(const char *data) {
+            return {U16::load(data), U16::load(data + 2)};
+        }
+    };
+
+    // Length on one byte, then the characters.
+    struct Str {
+        using value_type = std::string_view;
+        static constexpr bool fixed = false;
+        static constexpr size_t min_size = 1;
+
+        static size_t size(std::string_view str) {
+            return Writer::string_size(str);
+        }
+
+        static void write(Writer &writer, std::string_view str) {
+            writer.string(str);
+        }
+
+        static value_type read(Reader &reader) {
+            uint8_t length = reader.u8();
+            reader.need(length);
+            std::string_view str(reader.data + reader.index, length);
+            reader.index += length;
+            return str;
+        }
+
+        static bool skip(Reader &reader) {
+            if (!reader.has(1) || !reader.has(1 + (uint8_t) reader.data[reader.index]))
+                return false;
+            reader.index += 1 + (uint8_t) reader.data[reader.index];
+            return true;
+        }
+    };
+
+    // Several fields one after another, e.g. a map entry. Written from a tuple or a pair.
+    template<typename... Fields>
+    struct Tuple {
+        using value_type = std::tuple<typename Fields::value_type...>;
+        static constexpr bool fixed = (Fields::fixed && ...);
+        static constexpr size_t min_size = (Fields::min_size + ... + 0);
+
+        template<typename T>
+        static size_t size(const T &values) {
+            if constexpr (fixed)
+                return min_size;
+            else
+                return size(values, std::index_sequence_for<Fields...>());
+        }
+
+        template<typename T>
+        static void write(Writer &writer, const T &values) {
+            write(writer, values, std::index_sequence_for<Fields...>());
+        }
+
+        static value_type load(const char *data) requires fixed {
+            return load(data, std::index_sequence_for<Fields...>());
+        }
+
+        static value_type read(Reader &reader) {
+            if constexpr (fixed) {
+                reader.need(min_size);
+                value_type values = load(reader.data + reader.index);
+                reader.index += min_size;
+                return values;
+            } else {
+                // Braced initialization reads the fields in order.
+                return value_type{Fields::read(reader)...};
+            }
+        }
+
+        static bool skip(Reader &reader) {
+            if constexpr (fixed) {
+                if (!reader.has(min_size))
+                    return false;
+                reader.index += min_size;
+                return true;
+            } else {
+                return (Fields::skip(reader) && ...);
+            }
+        }
+
+    private:
+        template<typename T, size_t... I>
+        static size_t size(const T &values, std::index_sequence<I...>) {
+            return (Fields::size(std::get<I>(values)) + ... + 0);
+        }
+
+        template<typename T, size_t... I>
+        static void write(Writer &writer, const T &values, std::index_sequence<I...>) {
+            (Fields::write(writer, std::get<I>(values)), ...);
+        }
+
+        static constexpr std::array<size_t, sizeof...(Fields)> offsets() {
+            std::array<size_t, sizeof...(Fields)> result{};
+            size_t sizes[] = {Fields::min_size..., 0};
+            for (size_t i = 1; i < sizeof...(Fields); ++i)
+                result[i] = result[i - 1] + sizes[i - 1];
+            return result;
+        }
+
+        template<size_t... I>
+        static value_type load(const char *data, std::index_sequence<I...>) {
+            constexpr auto offset = offsets();
+            return value_type{Fields::load(data + offset[I])...};
+        }
+    };
+
+    // A range written through a projection, e.g. a map written as a list of tuples.
+    template<typename Range, typename Project>
+    struct Mapped {
+        const Range &range;
+        Project project;
+    };
+
+    template<typename Range, typename Project>
+    Mapped<Range, Project> mapped(const Range &range, Project project) {
+        return {range, project};
+    }
+
+    // Decoded list, elements are decoded again when iterated.
+    template<typename Field>
+    struct ListView {
+        const char *data = nullptr;
+        uint32_t count = 0;
+        size_t bytes = 0;
+
+        uint32_t size() const {
+            return count;
+        }
+
+        template<typename F>
+        void for_each(F &&function) const {
+            Reader reader(data, bytes);
+            for (uint32_t i = 0; i < count; ++i)
+                function(Field::read(reader));
+        }
+    };
+
+    // Number of elements on four bytes, then the elements. Can be written from any iterable
+    // range, from a Mapped one or from a board of positions with for_each(x, y).
+    template<typename Field>
+    struct List {
+        using value_type = ListView<Field>;
+        static constexpr bool fixed = false;
+        static constexpr size_t min_size = 4;
+
+        template<typename Range>
+        static size_t size(const Range &range) {
+            if constexpr (Field::fixed) {
+                return min_size + count(range) * Field::min_size;
+            } else {
+                size_t size = min_size;
+                for_each_element(range, [&size](const auto &element) {
+                    size += Field::size(element);
+                });
+                return size;
+            }
+        }
+
+        template<typename Range>
+        static void write(Writer &writer, const Range &range) {
+            writer.u32((uint32_t) count(range));
+            for_each_element(range, [&writer](const auto &element) {
+                Field::write(writer, element);
+            });
+        }
+
+        static value_type read(Reader &reader) {
+            value_type list;
+            list.count = reader.u32();
+            size_t start = reader.index;
+            if constexpr (Field::fixed) {
+                // Jedno sprawdzenie zakresu dla całej listy.
+                if ((reader.size - reader.index) / Field::min_size < list.count)
+                    throw Incomplete();
+                reader.index += (size_t) list.count * Field::min_size;
+            } else {
+                for (uint32_t i = 0; i < list.count; ++i)
+                    Field::read(reader);
+            }
+            list.data = reader.data + start;
+            list.bytes = reader.index - start;
+            return list;
+        }
+
+        static bool skip(Reader &reader) {
+            if (!reader.has(min_size))
+                return false;
+            uint32_t count = U32::load(reader.data + reader.index);
+            reader.index += min_size;
+            if constexpr (Field::fixed) {
+                if ((reader.size - reader.index) / Field::min_size < count)
+                    return false;
+                reader.index += (size_t) count * Field::min_size;
+            } else {
+                for (uint32_t i = 0; i < count; ++i) {
+                    if (!Field::skip(reader))
+                        return false;
+                }
+            }
+            return true;
+        }
+
+    private:
+        template<typename Range>
+        static size_t count(const Range &range) {
+            if constexpr (requires { range.project; })
+                return count(range.range);
+            else
+                return std::size(range);
+        }
+
+        template<typename Range, typename F>
+        static void for_each_element(const Range &range, F &&function) {
+            if constexpr (requires { range.project; }) {
+                for_each_element(range.range, [&](const auto &element) {
+                    function(range.project(element));
+                });
+            } else if constexpr (requires { std::begin(range); }) {
+                for (const auto &element: range)
+                    function(element);
+            } else {
+                range.for_each([&function](uint16_t x, uint16_t y) {
+                    function(Point{x, y});
+                });
+            }
+        }
+    };
+
+    // Message code on one byte, then the fields. A message made of fixed fields only is read
+    // with a single bounds check.
+    template<uint8_t CODE, typename... Fields>
+    struct Message {
+        using Body = Tuple<Fields...>;
+        using value_type = typename Body::value_type;
+        static constexpr uint8_t code = CODE;
+        static constexpr bool fixed = Body::fixed;
+        // Size of the whole message if it's fixed, of its fixed part otherwise.
+        static constexpr size_t min_size = 1 + Body::min_size;
+
+        template<typename... Ts>
+        static size_t size(const Ts &... values) {
+            static_assert(sizeof...(Ts) == sizeof...(Fields));
+            return 1 + (Fields::size(values) + ... + 0);
+        }
+
+        template<typename... Ts>
+        static void write(Writer &writer, const Ts &... values) {
+            static_assert(sizeof...(Ts) == sizeof...(Fields));
+            writer.u8(CODE);
+            (Fields::write(writer, values), ...);
+        }
+
+        // Writer holding exactly the encoded message.
+        template<typename... Ts>
+        static Writer encode(const Ts &... values) {
+            Writer writer(size(values...));
+            write(writer, values...);
+            return writer;
+        }
+
+        // Fields of the message, its code has already been read.
+        static value_type read_body(Reader &reader) {
+            return Body::read(reader);
+        }
+
+        // Moves past the fields if all of them have arrived, the reader is left anywhere if not.
+        static bool skip_body(Reader &reader) {
+            return Body::skip(reader);
+        }
+    };
+
+    // Server -> client.
+    using Hello = Message<0, Str, U8, U16, U16, U16, U16, U16>;
+    using AcceptedPlayer = Message<1, U8, Str, Str>;
+    using GameStarted = Message<2, List<Tuple<U8, Str, Str>>>;
+    // Followed by as many events as the second field says.
+    using TurnHeader = Message<3, U16, U32>;
+    using GameEnded = Message<4, List<Tuple<U8, U32>>>;
+    // Positions, scores, blocks and bombs (id, position, turns left) after the given turn.
+    using Snapshot = Message<5, U16, List<Tuple<U8, Pos>>, List<Tuple<U8, U32>>, List<Pos>,
+            List<Tuple<U32, Pos, U16>>>;
+
+    // Turn events.
+    using BombPlaced = Message<0, U32, Pos>;
+    using BombExploded = Message<1, U32, List<U8>, List<Pos>>;
+    using PlayerMoved = Message<2, U8, Pos>;
+    using BlockPlaced = Message<3, Pos>;
+
+    // Client -> server.
+    using Join = Message<0, Str>;
+    using PlaceBomb = Message<1>;
+    using PlaceBlock = Message<2>;
+    using Move = Message<3, U8>;
+
+    // Client -> GUI.
+    using Lobby = Message<0, Str, U8, U16, U16, U16, U16, U16, List<Tuple<U8, Str, Str>>>;
+    // Bombs are (position, turns left).
+    using Game = Message<1, Str, U16, U16, U16, U16, List<Tuple<U8, Str, Str>>,
+            List<Tuple<U8, Pos>>, List<Pos>, List<Tuple<Pos, U16>>, List<Pos>,
+            List<Tuple<U8, U32>>>;
+    // Changes from the state of the first turn to the state of the second one, sent in delta
+    // mode between full Game messages. A GUI not at the first turn waits for the next Game.
+    // Robots that moved, blocks removed, blocks added, bombs removed, bombs added, explosions
+    // and scores that changed. Removals go before additions, a removed bomb is the one at its
+    // position closest to exploding, bombs that stay count down by the turns in between.
+    using GameDelta = Message<2, U16, U16, List<Tuple<U8, Pos>>, List<Pos>, List<Pos>, List<Pos>,
+            List<Tuple<Pos, U16>>, List<Pos>, List<Tuple<U8, U32>>>;
+    // Piece of a Lobby, Game or GameDelta message too big for one datagram: turn, number of the
+    // message, number of the chunk and of all its chunks, then the piece till the end of the
+    // datagram. Chunks are sent in order, the message is theirs concatenated.
+    using GuiChunk = Message<3, U16, U32, U16, U16>;
+
+    // GUI -> client.
+    using GuiPlaceBomb = Message<0>;
+    using GuiPlaceBlock = Message<1>;
+    using GuiMove = Message<2, U8>;
+}
@@ -0,0 +1,46 @@
+#include <cstdint>
+#include <cstring>
+#include <endian.h>
+
+// Thrown by Reader when a message hasn't fully arrived yet.
+struct Incomplete {};
+
+// Bounds-checked cursor over received bytes, the counterpart of Writer. Decodes big-endian
+// fields straight from memory, no suspending on the way.
+struct Reader {
+    const char *data;
+    size_t size;
+    size_t index = 0;
+
+    Reader(const char *data, size_t size) : data(data), size(size) {}
+
+    bool has(size_t n) const {
+        return size - index >= n;
+    }
+
+    void need(size_t n) const {
+        if (!has(n))
+            throw Incomplete();
+    }
+
+    uint8_t u8() {
+        need(1);
+        return (uint8_t) data[index++];
+    }
+
+    uint16_t u16() {
+        uint16_t number;
+        need(sizeof(number));
+        memcpy(&number, data + index, sizeof(number));
+        index += sizeof(number);
+        return be16toh(number);
+    }
+
+    uint32_t u32() {
+        uint32_t number;
+        need(sizeof(number));
+        memcpy(&number, data + index, sizeof(number));
+        index += sizeof(number);
+        return be32toh(number);
+    }
+};
@@ -0,0 +1,168 @@
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <boost/program_options.hpp>
+#include <chrono>
+#include <cstdlib>
+#include <exception>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <optional>
+#include <string>
+#include <variant>
+#include <array>
+#include <cstring>
+#include <stdexcept>
+#include <memory>
+
+#include "server-params-parsing.hpp"
+#include "declarations.hpp"
+#include "board.hpp"
+#include "writer.hpp"
+#include "reader.hpp"
+#include "protocol.hpp"
+#include "includes.hpp"
+#include "server-deserialization.hpp"
+#include "server-engine.hpp"
+#include "server-bots.hpp"
+
+// Liczba alokacji od startu programu. Zastąpione operatory nie mogą być wstawiane w miejsca
+// wywołań, bo kompilator zgłasza wtedy free() na pamięci z new.
+static uint64_t allocations = 0;
+
+[[gnu::noinline]] void *operator new(size_t size) {
+    allocations++;
+    if (void *pointer = std::malloc(size == 0 ? 1 : size))
+        return pointer;
+    throw std::bad_alloc();
+}
+
+[[gnu::noinline]] void operator delete(void *pointer) noexcept {
+    std::free(pointer);
+}
+
+[[gnu::noinline]] void operator delete(void *pointer, size_t) noexcept {
+    std::free(pointer);
+}
+
+namespace po = boost::program_options;
+
+struct BenchParams {
+    uint16_t size_x;
+    uint16_t size_y;
+    uint16_t players_count;
+    uint16_t game_length;
+    uint16_t games;
+    uint16_t bomb_timer;
+    uint16_t explosion_radius;
+    uint16_t initial_blocks;
+    uint32_t seed;
+};
+
+static BenchParams parse_bench_params(int argc, char **argv) {
+    BenchParams params;
+    po::options_description desc("Options");
+    desc.add_options()
+            ("help,h", "Print help information")
+            ("size-x,x", po::value<uint16_t>(&params.size_x)->default_value(20))
+            ("size-y,y", po::value<uint16_t>(&params.size_y)->default_value(20))
+            ("players-count,p", po::value<uint16_t>(&params.players_count)->default_value(4))
+            ("game-length,l", po::value<uint16_t>(&params.game_length)->default_value(1000))
+            ("games,g", po::value<uint16_t>(&params.games)->default_value(10))
+            ("bomb-timer,b", po::value<uint16_t>(&params.bomb_timer)->default_value(5))
+            ("explosion-radius,e", po::value<uint16_t>(&params.explosion_radius)->default_value(4))
+            ("initial-blocks,k", po::value<uint16_t>(&params.initial_blocks)->default_value(40))
+            ("seed,s", po::value<uint32_t>(&params.seed)->default_value(1));
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    if (vm.count("help")) {
+        std::cout << desc << "\n";
+        exit(0);
+    }
+    po::notify(vm);
+    if (params.size_x == 0 || params.size_y == 0 || params.players_count == 0 ||
+        params.players_count > 255 || params.games == 0)
+        throw std::invalid_argument("invalid benchmark parameters");
+    return params;
+}
+
+struct BenchResult {
+    uint64_t turns = 0;
+    uint64_t events = 0;
+    uint64_t allocations = 0;
+    uint64_t deaths = 0;
+    std::chrono::steady_clock::duration time = std::chrono::steady_clock::duration::zero();
+};
+
+static void play_game(GameInfo &game_info, Engine &engine,
+                      std::vector <Bots::Bot> &bots, BenchResult &result) {
+    AddressPair address("[::1]:0");
+    for (player_id_t id = 0; id < game_info.players_count; ++id)
+        game_info.players.insert({id, Player("bot" + std::to_string(id), address)});
+
+    uint64_t allocations_before = allocations;
+    auto start = std::chrono::steady_clock::now();
+    engine.start_game();
+    for (;;) {
+        if (game_info.current_turn > 0) {
+            for (player_id_t id = 0; id < game_info.players_count; ++id)
+                bots[id](engine, id);
+        }
+        Turn &turn = engine.play_turn();
+        result.events += turn.events_count();
+        result.turns++;
+        if (game_info.last_turn_finished())
+            break;
+        engine.next_turn();
+    }
+    for (auto &score: game_info.player_score_map)
+        result.deaths += score.second;
+    engine.end_game();
+    result.time += std::chrono::steady_clock::now() - start;
+    result.allocations += allocations - allocations_before;
+}
+
+int main(int argc, char **argv) {
+    try {
+        BenchParams params = parse_bench_params(argc, argv);
+        ServerProgramParams::ServerProgramParams program_params(
+                params.bomb_timer, params.players_count, 0, params.explosion_radius,
+                params.initial_blocks, params.game_length, "bench", 0, params.size_x,
+                params.size_y, params.seed);
+        GameInfo game_info(program_params);
+        Engine engine(game_info);
+
+        // Every player plays the random bot.
+        std::vector <Bots::Bot> bots;
+        for (uint32_t i = 0; i < params.players_count; ++i)
+            bots.push_back(Bots::random_bot(params.seed + 1 + i));
+
+        BenchResult result;
+        for (uint16_t i = 0; i < params.games; ++i)
+            play_game(game_info, engine, bots, result);
+
+        double seconds = std::chrono::duration<double>(result.time).count();
+        double nanoseconds = std::chrono::duration<double, std::nano>(result.time).count();
+        std::cout << std::fixed << std::setprecision(1)
+                  << params.size_x << "x" << params.size_y
+                  << " players " << params.players_count
+                  << " games " << params.games
+                  << " turns " << result.turns
+                  << " events " << result.events
+                  << " | " << (double) result.turns / seconds << " turns/s"
+                  << ", " << (result.events ? nanoseconds / (double) result.events : 0)
+                  << " ns/event"
+                  << ", " << std::setprecision(2)
+                  << (double) result.allocations / (double) result.turns << " allocs/turn"
+                  << " | deaths " << result.deaths << "\n";
+    } catch (std::exception &e) {
+        std::cerr << "error: " << e.what() << "\n";
+        exit(1);
+    }
+    return 0;
+}
@@ -10,171 +10,323 @@
 #include <boost/spirit/home/x3.hpp>
 #include <boost/spirit/include/qi.hpp>
 #include <boost/spirit/include/qi_string.hpp>
+#include <atomic>
 #include <cstdlib>
 #include <exception>
 #include <iostream>
 #include <iterator>
+#include <memory>
+#include <optional>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include "params_parsing.hpp"
+#include "board.hpp"
+#include "writer.hpp"
+#include "reader.hpp"
+#include "protocol.hpp"
 #include "game.hpp"
 #include "serialization.hpp"
 #include "deserialization.hpp"
+#include "policies.hpp"
+
+// One player: its connection to the server, its GUI sockets and everything decoded from them.
+// Sessions share nothing, and both listeners of a session run on its strand, so a process can
+// play many players on a pool of threads.
+struct Session {
+    size_t number;
+    GameInfo game_info;
+    boost::asio::ip::tcp::socket server_socket;
+    boost::asio::ip::udp::socket gui_socket;
+    boost::asio::ip::udp::socket gui_socket_listen;
+    boost::asio::ip::udp::endpoint gui_endpoint;
+    Deserialization::ServerStream stream;
+    Deserialization::GuiDatagram gui_datagram;
+    // Set in headless mode, where it takes the place of the GUI.
+    Policies::Policy policy;
+    bool received_hello = false;
+    bool just_received_game_started = false;
+
+    template<typename Executor>
+    Session(size_t number, const Executor &executor) : number(number), server_socket(executor),
+                                                       gui_socket(executor),
+                                                       gui_socket_listen(executor) {}
+};
+
+// Sessions still connected. The process fails once all of them did.
+static std::atomic <size_t> live_sessions{0};
+
+static void fail_session(Session &session, std::exception &e) {
+    std::cerr << "error: ";
+    if (session.number > 0 || live_sessions > 1)
+        std::cerr << "session " << session.number << ": ";
+    std::cerr << e.what() << "\n";
+    boost::system::error_code ignored;
+    session.server_socket.close(ignored);
+    session.gui_socket_listen.close(ignored);
+    if (--live_sessions == 0)
+        exit(1);
+}
 
 static boost::asio::awaitable<void>
-gui_listener(boost::asio::ip::udp::socket *socket_listen,
-             boost::asio::ip::tcp::socket *server_socket, GameInfo &game_info) {
-    size_t read;
+gui_listener(Session &session) {
+    GameInfo &game_info = session.game_info;
+    Deserialization::GuiDatagram &datagram = session.gui_datagram;
+    boost::asio::ip::tcp::socket *server_socket = &session.server_socket;
     for (;;) {
-        co_await Deserialization::receive_udp_datagram(socket_listen, read);
-        if (!game_info.join_sent && Deserialization::gui_datagram_is_legit(read)) {
-            co_await Serialization::send_message_to_server(server_socket, SEND_JOIN_CODE,
-                                                           game_info.my_player_name);
+        try {
+            co_await datagram.receive(&session.gui_socket_listen);
+        } catch (std::exception &) {
+            // Gniazdo zamknięte razem z sesją.
+            co_return;
+        }
+        if (!game_info.join_sent && datagram.is_legit()) {
+            co_await Serialization::send_to_server<Protocol::Join>(server_socket,
+                                                                   game_info.my_player_name);
             game_info.join_sent = true;
-        } else if (Deserialization::gui_datagram_is_legit(read) && !game_info.in_lobby) {
-            co_await Deserialization::react_to_gui_message(server_socket);
+        } else if (datagram.is_legit() && !game_info.in_lobby) {
+            co_await Deserialization::react_to_gui_message(server_socket, datagram);
         }
     }
     co_return;
 }
 
-static boost::asio::awaitable<void>
-listen_to_hello_message(GameInfo &game_info, boost::asio::ip::tcp::socket *socket,
+// Every message is decoded whole, even if it's ignored, so the stream stays in sync.
+static void
+listen_to_hello_message(GameInfo &game_info, Reader &reader,
                         bool &received_hello) {
+    Message::HelloMessage message = Deserialization::receive_hello_message(reader);
     if (!received_hello) {
         received_hello = true;
-        Message::HelloMessage message = co_await
-        Deserialization::receive_hello_message(socket);
         game_info.update_with_hello_info(message);
     }
 }
 
-static boost::asio::awaitable<void>
-listen_to_accepted_player_message(GameInfo &game_info, boost::asio::ip::tcp::socket *socket) {
-    if (game_info.in_lobby) {
-        Message::AcceptedPlayerMessage message = co_await
-        Deserialization::receive_accepted_player_message(
-                socket);
+static void
+listen_to_accepted_player_message(GameInfo &game_info, Reader &reader) {
+    Message::AcceptedPlayerMessage message =
+            Deserialization::receive_accepted_player_message(reader);
+    if (game_info.in_lobby)
         game_info.update_with_accepted_player_info(message);
-    }
 }
 
-static boost::asio::awaitable<void>
-listen_to_game_started_message(GameInfo &game_info, boost::asio::ip::tcp::socket *socket,
+static void
+listen_to_game_started_message(GameInfo &game_info, Reader &reader,
                                bool &just_received_game_started) {
+    Message::GameStartedMessage message = Deserialization::receive_game_started_message(reader);
     if (game_info.in_lobby) {
         just_received_game_started = true;
-        Message::GameStartedMessage message = co_await
-        Deserialization::receive_game_started_message(
-                socket);
         game_info.update_with_game_started_info(message);
     }
 }
 
-static boost::asio::awaitable<void>
-listen_to_turn_message(GameInfo &game_info, boost::asio::ip::tcp::socket *socket) {
+static void
+listen_to_turn_message(GameInfo &game_info, Reader &reader) {
+    Message::TurnMessage message = Deserialization::receive_turn_message(reader);
     game_info.explosions.clear();
-    Message::TurnMessage message = co_await
-    Deserialization::receive_turn_message(socket);
     game_info.update_with_turn_info(message);
 }
 
-static boost::asio::awaitable<void>
-listen_to_game_ended_message(GameInfo &game_info, boost::asio::ip::tcp::socket *socket) {
-    co_await Deserialization::receive_game_ended_message(socket);
+static void
+listen_to_snapshot_message(GameInfo &game_info, Reader &reader) {
+    Message::SnapshotMessage message = Deserialization::receive_snapshot_message(reader);
+    game_info.update_with_snapshot_info(message);
+}
+
+static void
+listen_to_game_ended_message(GameInfo &game_info, Reader &reader) {
+    Deserialization::receive_game_ended_message(reader);
     game_info.update_with_game_ended_info();
 }
 
+// Decodes and applies a single message which has fully arrived, returns its code.
+static uint8_t
+handle_server_message(GameInfo &game_info, Reader &reader,
+                      bool &received_hello, bool &just_received_game_started) {
+    uint8_t code = reader.u8();
+    switch (code) {
+        case Protocol::Hello::code: {
+            listen_to_hello_message(game_info, reader, received_hello);
+            break;
+        }
+        case Protocol::AcceptedPlayer::code: {
+            listen_to_accepted_player_message(game_info, reader);
+            break;
+        }
+        case Protocol::GameStarted::code: {
+            listen_to_game_started_message(game_info, reader, just_received_game_started);
+            break;
+        }
+        case Protocol::TurnHeader::code: {
+            listen_to_turn_message(game_info, reader);
+            break;
+        }
+        case Protocol::Snapshot::code: {
+            listen_to_snapshot_message(game_info, reader);
+            break;
+        }
+        case Protocol::GameEnded::code: {
+            listen_to_game_ended_message(game_info, reader);
+            break;
+        }
+        default: {
+            throw std::runtime_error("Invalid message from server.");
+            break;
+        }
+    }
+    return code;
+}
+
 static boost::asio::awaitable<void>
 inform_gui(GameInfo &game_info, boost::asio::ip::udp::socket *send_udp_socket,
            boost::asio::ip::udp::endpoint &endpoint,
            bool &just_received_game_started) {
-    if (just_received_game_started)
+    if (just_received_game_started) {
         just_received_game_started = false;
-    else if (game_info.in_lobby)
+    } else if (game_info.in_lobby) {
+        game_info.gui_game_state_dropped();
         co_await Serialization::send_lobby_message(send_udp_socket, endpoint, game_info);
-    else
+    } else if (game_info.gui_needs_keyframe()) {
         co_await Serialization::send_game_message(send_udp_socket, endpoint, game_info);
+        game_info.gui_game_state_sent(true);
+    } else {
+        co_await Serialization::send_game_delta_message(send_udp_socket, endpoint, game_info);
+        game_info.gui_game_state_sent(false);
+    }
 }
 
+// Headless mode: joins whenever it's back in the lobby and gives the policy's input to the
+// server after every turn, the way gui_listener does with the GUI's.
 static boost::asio::awaitable<void>
-server_listener(boost::asio::ip::tcp::socket *socket, boost::asio::ip::udp::socket *send_udp_socket,
-                boost::asio::ip::udp::endpoint &endpoint, GameInfo &game_info) {
-    bool received_hello = false;
-    bool just_received_game_started = false;
+play(Session &session, uint8_t code) {
+    GameInfo &game_info = session.game_info;
+    session.just_received_game_started = false;
+    if (game_info.in_lobby && !game_info.join_sent && session.received_hello) {
+        co_await Serialization::send_to_server<Protocol::Join>(&session.server_socket,
+                                                               game_info.my_player_name);
+        game_info.join_sent = true;
+    } else if (code == Protocol::TurnHeader::code && !game_info.in_lobby) {
+        std::optional <Policies::Input> input = session.policy(game_info);
+        if (input && input->is_legit())
+            co_await Deserialization::react_to_gui_message(&session.server_socket, *input);
+    }
+}
+
+static boost::asio::awaitable<void>
+server_listener(Session &session) {
+    GameInfo &game_info = session.game_info;
+    Deserialization::ServerStream &stream = session.stream;
     for (;;) {
         try {
-            buffer_index = 0;
-            co_await Deserialization::receive_n_bytes(1, socket);
-            switch (shared_buffer[0]) {
-                case HELLO_CODE: {
-                    co_await listen_to_hello_message(game_info, socket, received_hello);
-                    break;
-                }
-                case ACCEPTED_PLAYER_CODE: {
-                    co_await listen_to_accepted_player_message(game_info, socket);
-                    break;
-                }
-                case GAME_STARTED_CODE: {
-                    co_await listen_to_game_started_message(game_info, socket,
-                                                            just_received_game_started);
-                    break;
-                }
-                case TURN_CODE: {
-                    co_await listen_to_turn_message(game_info, socket);
-                    break;
-                }
-                case GAME_ENDED_CODE: {
-                    co_await listen_to_game_ended_message(game_info, socket);
-                    break;
-                }
-                default: {
-                    throw std::runtime_error("Invalid message from server.");
+            co_await stream.receive(&session.server_socket);
+        } catch (std::exception &e) {
+            fail_session(session, e);
+            co_return;
+        }
+        for (;;) {
+            std::optional <Reader> reader;
+            uint8_t code;
+            try {
+                reader = stream.next();
+                if (!reader)
                     break;
-                }
+                code = handle_server_message(game_info, *reader, session.received_hello,
+                                             session.just_received_game_started);
+            } catch (Incomplete &) {
+                // The message has arrived, it's its own lengths that don't add up.
+                std::runtime_error e("Invalid message from server.");
+                fail_session(session, e);
+                co_return;
+            } catch (std::exception &e) {
+                fail_session(session, e);
+                co_return;
             }
-        } catch (std::exception &e) {
-            std::cerr << "error: " << e.what() << "\n";
-            exit(1);
+            stream.consume(*reader);
+            if (session.policy)
+                co_await play(session, code);
+            else
+                co_await inform_gui(game_info, &session.gui_socket, session.gui_endpoint,
+                                    session.just_received_game_started);
         }
-        co_await inform_gui(game_info, send_udp_socket, endpoint, just_received_game_started);
     }
     co_return;
 }
 
+// Port of the given session: the one given for the first session, the next ones after it.
+static std::string session_port(const std::string &port, size_t number) {
+    if (number == 0)
+        return port;
+    return std::to_string(std::stoul(port) + number);
+}
+
 static void robots_client(ProgramParams::ProgramParams &program_params) {
-    GameInfo game_info;
-    game_info.my_player_name = program_params.player_name; // Set player name.
-    boost::asio::io_context io_context;
-    // Set up TCP socket.
+    if (program_params.gui_max_datagram <= Protocol::GuiChunk::min_size ||
+        program_params.gui_max_datagram > 65507)
+        throw std::invalid_argument("gui-max-datagram has to be between 12 and 65507");
+    if (program_params.sessions == 0 || program_params.threads == 0)
+        throw std::invalid_argument("sessions and threads have to be positive");
+    if (!program_params.headless && program_params.port + program_params.sessions - 1u > UINT16_MAX)
+        throw std::invalid_argument("not enough ports after port for all the sessions");
+    // Nieznana polityka ma wyjść przed połączeniem z serwerem.
+    if (program_params.headless)
+        Policies::make_policy(program_params.policy, program_params.seed);
+    boost::asio::io_context io_context(program_params.threads);
     boost::asio::ip::tcp::resolver server_resolver(io_context);
     boost::asio::ip::tcp::resolver::results_type server_endpoint = server_resolver.resolve(
             program_params.server_address.host, program_params.server_address.port);
-    boost::asio::ip::tcp::no_delay option(true); // Disable Nagle's algorithm.
-    boost::asio::ip::tcp::socket server_socket(io_context);
-    boost::asio::connect(server_socket, server_endpoint);
-    server_socket.set_option(option);
-    // Set up UDP socket for sending datagrams.
     boost::asio::ip::udp::resolver gui_resolver(io_context);
-    boost::asio::ip::udp::endpoint gui_endpoint = *gui_resolver.resolve(
-            program_params.gui_address.host,
-            program_params.gui_address.port).begin();
-    boost::asio::ip::udp::socket gui_socket(io_context);
-    gui_socket.open(boost::asio::ip::udp::v6());
-    // Set up UDP socket for receiving datagrams.
-    boost::asio::ip::udp::socket gui_socket_listen(io_context);
-    gui_socket_listen.open(boost::asio::ip::udp::v6());
-    gui_socket_listen.bind({boost::asio::ip::udp::v6(), program_params.port});
+    std::vector <std::unique_ptr<Session>> sessions;
+    for (size_t number = 0; number < program_params.sessions; ++number) {
+        auto session = std::make_unique<Session>(number, boost::asio::make_strand(io_context));
+        GameInfo &game_info = session->game_info;
+        game_info.my_player_name = program_params.player_name; // Set player name.
+        if (program_params.sessions > 1)
+            game_info.my_player_name += "-" + std::to_string(number);
+        if (program_params.gui_delta)
+            game_info.gui_keyframe_interval = program_params.gui_keyframe_interval;
+        game_info.gui_max_datagram = program_params.gui_max_datagram;
+        // Set up TCP socket.
+        boost::asio::ip::tcp::no_delay option(true); // Disable Nagle's algorithm.
+        boost::asio::connect(session->server_socket, server_endpoint);
+        session->server_socket.set_option(option);
+        game_info.my_endpoint = session->server_socket.local_endpoint();
+        if (program_params.headless) {
+            session->policy = Policies::make_policy(program_params.policy,
+                                                    program_params.seed + (uint32_t) number);
+            sessions.push_back(std::move(session));
+            continue;
+        }
+        // Set up UDP socket for sending datagrams.
+        session->gui_endpoint = *gui_resolver.resolve(
+                program_params.gui_address.host,
+                session_port(program_params.gui_address.port, number)).begin();
+        session->gui_socket.open(boost::asio::ip::udp::v6());
+        // Set up UDP socket for receiving datagrams.
+        session->gui_socket_listen.open(boost::asio::ip::udp::v6());
+        session->gui_socket_listen.bind({boost::asio::ip::udp::v6(),
+                                         (uint16_t) (program_params.port + number)});
+        sessions.push_back(std::move(session));
+    }
+    live_sessions = sessions.size();
 
     boost::asio::signal_set signals(io_context, SIGINT, SIGTERM);
     signals.async_wait([&](auto, auto) { io_context.stop(); });
 
-    boost::asio::co_spawn(io_context, gui_listener(&gui_socket_listen, &server_socket, game_info),
-                          boost::asio::detached);
-    boost::asio::co_spawn(io_context, server_listener(&server_socket, &gui_socket, gui_endpoint,
-                                                      game_info), boost::asio::detached);
+    for (auto &session: sessions) {
+        if (!session->policy)
+            boost::asio::co_spawn(session->server_socket.get_executor(), gui_listener(*session),
+                                  boost::asio::detached);
+        boost::asio::co_spawn(session->server_socket.get_executor(), server_listener(*session),
+                              boost::asio::detached);
+    }
 
+    std::vector <std::thread> threads;
+    for (uint16_t i = 1; i < program_params.threads; ++i)
+        threads.emplace_back([&io_context] { io_context.run(); });
     io_context.run();
+    for (auto &thread: threads)
+        thread.join();
 }
 
 int main(int argc, char **argv) {
@@ -0,0 +1,309 @@
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <utility>
+#include <boost/asio.hpp>
+#include <boost/program_options.hpp>
+#include <algorithm>
+#include <cstdlib>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <optional>
+#include <set>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "writer.hpp"
+#include "reader.hpp"
+#include "protocol.hpp"
+
+// Reference GUI side of robots-client, for testing without the real GUI. Listens for the
+// client's datagrams, puts chunked messages back together, keeps the game state the GUI would
+// show (applying GameDelta messages to the last full one) and prints a line per message.
+
+using budp = boost::asio::ip::udp;
+
+struct ReceiverParams {
+    uint16_t port;
+    bool quiet;
+};
+
+static ReceiverParams parse_receiver_params(int argc, char **argv) {
+    ReceiverParams params;
+    boost::program_options::options_description desc("Allowed options");
+    desc.add_options()
+            ("help,h", "produce help message")
+            ("port,p", boost::program_options::value<uint16_t>(&params.port)->required(),
+             "port the client sends the GUI datagrams to")
+            ("quiet,q", boost::program_options::bool_switch(&params.quiet),
+             "only print the counters when stopped");
+    boost::program_options::variables_map vm;
+    boost::program_options::store(boost::program_options::parse_command_line(argc, argv, desc),
+                                  vm);
+    if (vm.count("help")) {
+        std::cout << desc << "\n";
+        exit(0);
+    }
+    boost::program_options::notify(vm);
+    return params;
+}
+
+using Position = std::pair<uint16_t, uint16_t>;
+
+static Position to_position(Protocol::Point point) {
+    return {point.x, point.y};
+}
+
+// What the GUI shows during a game.
+struct GuiState {
+    bool valid = false;
+    uint16_t turn = 0;
+    std::map <uint8_t, Position> positions;
+    std::set <Position> blocks;
+    // (position, turns left)
+    std::vector <std::pair<Position, uint16_t>> bombs;
+    std::set <Position> explosions;
+    std::map <uint8_t, uint32_t> scores;
+
+    void apply_game(Reader &reader) {
+        auto [server_name, size_x, size_y, game_length, game_turn, players, player_positions,
+                game_blocks, game_bombs, game_explosions, game_scores] =
+                Protocol::Game::read_body(reader);
+        *this = GuiState();
+        valid = true;
+        turn = game_turn;
+        player_positions.for_each([this](auto entry) {
+            positions[std::get<0>(entry)] = to_position(std::get<1>(entry));
+        });
+        game_blocks.for_each([this](auto position) { blocks.insert(to_position(position)); });
+        game_bombs.for_each([this](auto bomb) {
+            bombs.emplace_back(to_position(std::get<0>(bomb)), std::get<1>(bomb));
+        });
+        game_explosions.for_each([this](auto position) {
+            explosions.insert(to_position(position));
+        });
+        game_scores.for_each([this](auto entry) {
+            scores[std::get<0>(entry)] = std::get<1>(entry);
+        });
+    }
+
+    // False if the delta isn't from the state held, which is then dropped till the next Game.
+    bool apply_delta(Reader &reader) {
+        auto [base_turn, delta_turn, moved, blocks_removed, blocks_added, bombs_removed,
+                bombs_added, delta_explosions, scores_changed] =
+                Protocol::GameDelta::read_body(reader);
+        if (!valid || turn != base_turn) {
+            valid = false;
+            return false;
+        }
+        moved.for_each([this](auto entry) {
+            positions[std::get<0>(entry)] = to_position(std::get<1>(entry));
+        });
+        blocks_removed.for_each([this](auto position) { blocks.erase(to_position(position)); });
+        blocks_added.for_each([this](auto position) { blocks.insert(to_position(position)); });
+        for (auto &bomb: bombs)
+            bomb.second = (uint16_t) (bomb.second - (delta_turn - base_turn));
+        bombs_removed.for_each([this](auto point) {
+            Position position = to_position(point);
+            auto closest = bombs.end();
+            for (auto bomb = bombs.begin(); bomb != bombs.end(); ++bomb) {
+                if (bomb->first == position &&
+                    (closest == bombs.end() || bomb->second < closest->second))
+                    closest = bomb;
+            }
+            if (closest != bombs.end())
+                bombs.erase(closest);
+        });
+        bombs_added.for_each([this](auto bomb) {
+            bombs.emplace_back(to_position(std::get<0>(bomb)), std::get<1>(bomb));
+        });
+        explosions.clear();
+        delta_explosions.for_each([this](auto position) {
+            explosions.insert(to_position(position));
+        });
+        scores_changed.for_each([this](auto entry) {
+            scores[std::get<0>(entry)] = std::get<1>(entry);
+        });
+        turn = delta_turn;
+        return true;
+    }
+};
+
+// Chunks of the messages not complete yet, by message number. A message that completes drops
+// every older one still missing chunks, those chunks were lost or come too late.
+struct Reassembly {
+    static constexpr size_t MAX_PENDING = 16;
+
+    struct Pending {
+        uint16_t count = 0;
+        uint16_t received = 0;
+        std::vector <std::string> pieces;
+    };
+
+    std::map <uint32_t, Pending> pending;
+    bool any_completed = false;
+    uint32_t last_completed = 0;
+    uint64_t dropped = 0;
+
+    // The whole message, once its last missing chunk arrives.
+    std::optional <std::string> add(Reader &reader) {
+        auto [turn, number, index, count] = Protocol::GuiChunk::read_body(reader);
+        (void) turn;
+        if ((any_completed && number <= last_completed) || count == 0 || index >= count)
+            return std::nullopt;
+        Pending &message = pending[number];
+        if (message.count == 0) {
+            message.count = count;
+            message.pieces.resize(count);
+        }
+        if (message.count != count || !message.pieces[index].empty())
+            return std::nullopt;
+        message.pieces[index].assign(reader.data + reader.index, reader.size - reader.index);
+        if (++message.received < message.count) {
+            if (pending.size() > MAX_PENDING) {
+                pending.erase(pending.begin());
+                dropped++;
+            }
+            return std::nullopt;
+        }
+        std::string whole;
+        for (auto &piece: message.pieces)
+            whole += piece;
+        auto end = pending.upper_bound(number);
+        dropped += (uint64_t) std::distance(pending.begin(), end) - 1;
+        pending.erase(pending.begin(), end);
+        any_completed = true;
+        last_completed = number;
+        return whole;
+    }
+};
+
+struct Receiver {
+    ReceiverParams &params;
+    GuiState state;
+    Reassembly reassembly;
+    uint64_t datagrams = 0;
+    uint64_t chunks = 0;
+    uint64_t lobbies = 0;
+    uint64_t games = 0;
+    uint64_t deltas = 0;
+    uint64_t deltas_skipped = 0;
+    uint64_t invalid = 0;
+
+    Receiver(ReceiverParams &params) : params(params) {}
+
+    void receive(const char *data, size_t size) {
+        datagrams++;
+        Reader reader(data, size);
+        try {
+            if (reader.u8() == Protocol::GuiChunk::code) {
+                chunks++;
+                std::optional <std::string> message = reassembly.add(reader);
+                if (message)
+                    handle(message->data(), message->size());
+            } else {
+                handle(data, size);
+            }
+        } catch (Incomplete &) {
+            invalid++;
+            std::cerr << "truncated datagram of " << size << " bytes\n";
+        }
+    }
+
+    void handle(const char *data, size_t size) {
+        Reader reader(data, size);
+        switch (reader.u8()) {
+            case Protocol::Lobby::code: {
+                auto [server_name, players_count, size_x, size_y, game_length, explosion_radius,
+                        bomb_timer, players] = Protocol::Lobby::read_body(reader);
+                lobbies++;
+                state = GuiState();
+                if (!params.quiet)
+                    std::cout << "lobby " << server_name << " " << size_x << "x" << size_y
+                              << ", players " << players.size() << "/"
+                              << (uint32_t) players_count << "\n";
+                break;
+            }
+            case Protocol::Game::code: {
+                state.apply_game(reader);
+                games++;
+                print("game", size);
+                break;
+            }
+            case Protocol::GameDelta::code: {
+                if (state.apply_delta(reader)) {
+                    deltas++;
+                    print("delta", size);
+                } else {
+                    deltas_skipped++;
+                    if (!params.quiet)
+                        std::cout << "delta skipped, waiting for a full state\n";
+                }
+                break;
+            }
+            default: {
+                invalid++;
+                std::cerr << "unknown message " << (uint32_t) (uint8_t) data[0] << "\n";
+                break;
+            }
+        }
+    }
+
+    void print(const char *kind, size_t size) {
+        if (params.quiet)
+            return;
+        std::cout << kind << " turn " << state.turn << " (" << size << " B): robots "
+                  << state.positions.size() << ", blocks " << state.blocks.size()
+                  << ", bombs " << state.bombs.size() << ", explosions "
+                  << state.explosions.size() << ", scores";
+        for (auto &[id, score]: state.scores)
+            std::cout << " " << (uint32_t) id << ":" << score;
+        std::cout << "\n";
+    }
+
+    void report() {
+        std::cout << datagrams << " datagrams (" << chunks << " chunks, "
+                  << reassembly.dropped << " messages incomplete), " << lobbies
+                  << " lobby, " << games << " game, " << deltas << " delta, "
+                  << deltas_skipped << " deltas skipped, " << invalid << " invalid\n";
+    }
+};
+
+int main(int argc, char **argv) {
+    try {
+        ReceiverParams params = parse_receiver_params(argc, argv);
+        boost::asio::io_context io_context;
+        budp::socket socket(io_context);
+        socket.open(budp::v6());
+        socket.bind({budp::v6(), params.port});
+        Receiver receiver(params);
+
+        boost::asio::signal_set signals(io_context, SIGINT, SIGTERM);
+        signals.async_wait([&](auto, auto) { io_context.stop(); });
+        std::vector<char> buffer(65536);
+        std::function<void()> receive = [&] {
+            socket.async_receive(boost::asio::buffer(buffer),
+                                 [&](boost::system::error_code error, size_t size) {
+                                     if (error)
+                                         return;
+                                     receiver.receive(buffer.data(), size);
+                                     std::cout.flush();
+                                     receive();
+                                 });
+        };
+        receive();
+        io_context.run();
+        receiver.report();
+    } catch (std::exception &e) {
+        std::cerr << "error: " << e.what() << "\n";
+        exit(1);
+    }
+    return 0;
+}
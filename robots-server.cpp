@@ -19,12 +19,30 @@
 #include <iterator>
 #include <string>
 #include <optional>
-
-#include "server_params_parsing.hpp"
+#include <deque>
+#include <variant>
+#include <array>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+#include "server-params-parsing.hpp"
 #include "declarations.hpp"
+#include "board.hpp"
+#include "writer.hpp"
+#include "reader.hpp"
+#include "protocol.hpp"
 #include "includes.hpp"
-#include "server_deserialization.hpp"
-#include "server_serialization.hpp"
+#include "server-deserialization.hpp"
+#include "server-serialization.hpp"
+#include "server-engine.hpp"
+#include "server-trace.hpp"
+#include "server-metrics.hpp"
+#include "server-connection.hpp"
+#include "server-tick-scheduler.hpp"
 
 using boost::asio::awaitable;
 using boost::asio::use_awaitable;
@@ -33,374 +51,490 @@ using boost::asio::co_spawn;
 using batcp = boost::asio::ip::tcp;
 using bastreambuf = boost::asio::streambuf;
 
-struct Server {
+using strand_t = boost::asio::strand<boost::asio::io_context::executor_type>;
+
+// A single game with its own clients. Sockets are read and written on per-connection strands,
+// possibly on many threads at once. Everything touching game_info or connections runs on
+// game_strand, so the game is simulated exactly as if the server was single-threaded.
+struct Room {
+    size_t index;
     GameInfo game_info;
-    uint16_t port;
-    std::set<batcp::socket *> sockets;
-
-    Server(GameInfo &game_info, uint16_t &port) : game_info(game_info), port(port) {};
-
-    awaitable <std::pair<player_id_t, Player>>
-    receive_join_message(batcp::socket *socket, GameInfo &game_info,
-                         Buffer &buffer) {
-        // deserialize accepted player, czyli wczytaj stringa name
-        Message::ReceiveJoinMessage message = co_await
-        Deserialization::deserialize_join_message(buffer, socket);
-        std::cout << "zdeserializowane\n";
-        std::string full_address = boost::lexical_cast<std::string>(
-                socket->remote_endpoint());
-        AddressPair address(full_address);
-        Player player(message.name, address);
+    Engine engine;
+    strand_t game_strand;
+    std::set<std::shared_ptr<Connection>> connections;
+    // Klienci, którzy dołączyli do bieżącej gry, i ich numery.
+    std::map<std::shared_ptr<Connection>, player_id_t> joined_connections;
+    // Czy do tego pokoju mogą jeszcze dołączać gracze, czytane przy wyborze pokoju dla klienta.
+    std::atomic<bool> accepting_players{true};
+    TickScheduler tick_scheduler;
+    // Stan gry dla strony z metrykami, uaktualniany po każdej turze.
+    std::atomic <size_t> active_bombs{0};
+    std::atomic <size_t> active_blocks{0};
+
+    Room(size_t index, ServerProgramParams::ServerProgramParams &program_params,
+         strand_t game_strand) :
+            index(index), game_info(program_params), engine(game_info), game_strand(std::move(game_strand)),
+            tick_scheduler(this->game_strand,
+                           std::chrono::milliseconds(game_info.turn_duration)) {};
+
+    // Returns std::nullopt if the room is full or its game is already on, the client has to
+    // join another room then. Join repeated by a player of the current game changes nothing.
+    std::optional <player_id_t>
+    do_join_message(Player &player, const std::shared_ptr<Connection> &connection) {
+        auto joined = joined_connections.find(connection);
+        if (joined != joined_connections.end())
+            return joined->second;
+        if (game_info.is_running || game_info.enough_clients_joined())
+            return std::nullopt;
         player_id_t id = (uint8_t) game_info.players.size();
-        co_return std::pair<player_id_t, Player>({id, player});
-    }
-
-    awaitable<void>
-    do_join_message(batcp::socket *socket, Buffer &buffer, player_id_t &my_player_id) {
-        std::pair <player_id_t, Player> player_pair = co_await
-        receive_join_message(socket, game_info, buffer);
-        game_info.players.insert(player_pair);
-        my_player_id = player_pair.first;
+        game_info.players.insert({id, player});
+        joined_connections[connection] = id;
         game_info.just_accepted_player = true;
+        if (game_info.enough_clients_joined()) {
+            game_info.game_started_to_be_sent = true;
+            accepting_players = false;
+        }
+        return id;
     }
 
-    awaitable<void>
-    do_place_bomb_message(player_id_t &my_player_id) {
-        Message::ReceivePlaceBombMessage message(my_player_id);
-        Event::BombPlaced event(game_info.total_bomb_placed_count++,
-                                game_info.player_position_map[message.player_id]);
-        game_info.turn_working_list.back().events[message.player_id] =
-                std::make_shared<Event::BombPlaced>(event);
-        co_return;
+    // Runs on the game strand, the connection waits for the assigned id.
+    awaitable <std::optional<player_id_t>>
+    join_game(Player player, std::shared_ptr<Connection> connection) {
+        co_return do_join_message(player, connection);
     }
 
-    awaitable<void>
-    do_place_block_message(player_id_t &my_player_id) {
-        Message::ReceivePlaceBlockMessage message(my_player_id);
-        Event::BlockPlaced event(game_info.player_position_map[message.player_id]);
-        game_info.turn_working_list.back().events[message.player_id] =
-                std::make_shared<Event::BlockPlaced>(event);
-        co_return;
+    void update_game_info_with_game_ended() {
+        engine.end_game();
+        game_info.game_started_frame.reset();
+        game_info.accepted_player_frames.clear();
+        game_info.snapshot_frame.reset();
+        game_info.snapshot_next_turn_index = 0;
+        joined_connections.clear();
+        accepting_players = true;
     }
 
-    std::optional <Position>
-    get_potential_new_position(Position &position, uint8_t direction) {
-        Position potential(position.x, position.y);
-        if (direction == Deserialization::UP) {
-            if (position.y == game_info.board_dimensions.size_y - 1)
-                return std::nullopt;
-            potential.y++;
-        } else if (direction == Deserialization::RIGHT) {
-            if (position.x == game_info.board_dimensions.size_x - 1)
-                return std::nullopt;
-            potential.x++;
-        } else if (direction == Deserialization::DOWN) {
-            if (position.y == 0)
-                return std::nullopt;
-            potential.y--;
-        } else if (direction == Deserialization::LEFT) {
-            if (position.x == 0)
-                return std::nullopt;
-            potential.x--;
+    void catch_up_with_running_game(Connection::Batch &batch) {
+        batch.push_back(game_info.game_started_frame);
+        // Stan gry z ostatniego zrzutu zamiast tur sprzed niego.
+        size_t first_turn_index = 0;
+        if (game_info.snapshot_frame) {
+            batch.push_back(game_info.snapshot_frame);
+            first_turn_index = game_info.snapshot_next_turn_index;
         }
-        if (game_info.block_position_set.contains({potential.x, potential.y}))
-            return std::nullopt;
-        return potential;
-    }
-
-    awaitable<void>
-    do_move_message(batcp::socket *socket, Buffer &buffer, player_id_t &my_player_id) {
-        Message::ReceiveMoveMessage message = co_await
-        Deserialization::deserialize_move_message(buffer, socket, my_player_id);
-
-        Position &my_position = game_info.player_position_map[message.player_id];
-        std::optional <Position> potential_position = get_potential_new_position(my_position,
-                                                                                 message.direction);
-        if (potential_position) {
-            Event::PlayerMoved event(my_player_id, potential_position.value());
-            game_info.turn_working_list.back().events[my_player_id] =
-                    std::make_shared<Event::PlayerMoved>(event);
+        // teraz wszystkie zalegle tury, juz zserializowane
+        for (size_t i = first_turn_index; i < game_info.turn_official_list.size(); ++i) {
+            if (game_info.turn_official_list[i].frame)
+                batch.push_back(game_info.turn_official_list[i].frame);
         }
-        co_return;
     }
 
-    void prepare_board() {
-        if (game_info.current_turn > 0)
+    void take_snapshot_if_due() {
+        if (game_info.snapshot_interval == 0 || game_info.current_turn == 0 ||
+            game_info.current_turn % game_info.snapshot_interval != 0)
             return;
-        for (player_id_t i = 0; i < game_info.players_count; ++i) {
-            Position position((uint16_t) game_info.random_number_generator.generate() %
-                              game_info.board_dimensions.size_x,
-                              (uint16_t) game_info.random_number_generator.generate() %
-                              game_info.board_dimensions.size_y);
-
-            game_info.player_position_map[i] = position;
-            game_info.player_score_map[i] = 0;
-            // dodaj zdarzenie PlayerMoved do listy
-            Event::PlayerMoved event(i, position);
-            game_info.turn_official_list.back().events[(uint32_t) game_info.turn_official_list.back().events.size()] =
-                    std::make_shared<Event::PlayerMoved>(event);
-        }
+        game_info.snapshot_frame = Serialization::serialize_snapshot_message(game_info);
+        game_info.snapshot_next_turn_index = game_info.turn_official_list.size();
+    }
 
-        for (uint16_t i = 0; i < game_info.initial_blocks; ++i) {
-            Position position;
-            position.x = (uint16_t) game_info.random_number_generator.generate() %
-                         game_info.board_dimensions.size_x;
-            position.y = (uint16_t) game_info.random_number_generator.generate() %
-                         game_info.board_dimensions.size_y;
-            game_info.block_position_set.insert(position);
-            Event::BlockPlaced event(position);
-            game_info.turn_official_list.back().events[(uint32_t) game_info.turn_official_list.back().events.size()] =
-                    std::make_shared<Event::BlockPlaced>(event);
-        }
+    void catch_up_with_game_in_lobby(Connection::Batch &batch) {
+        // game nie jest running, ale mogli juz dolaczyc jacys zawodnicy
+        for (auto &frame: game_info.accepted_player_frames)
+            batch.push_back(frame);
     }
 
-    Event::BombExploded do_bomb_exploded(uint32_t bomb_id, Bomb &bomb) {
-        Event::BombExploded event;
-        event.id = bomb_id;
-        // First find where the bomb explodes.
-        event.calc_explosion(game_info, bomb);
-        // Find robots and blocks standing on positions where the explosion is taking place.
-        event.create_blocks_destroyed_list(game_info.block_position_set);
-        event.create_robots_destroyed_list(game_info.player_position_map);
-        std::cout << "destroyed " << event.robots_destroyed.size() << " and "
-                  << event.blocks_destroyed.size() << " blocks\n";
-        return event;
-    }
-
-    void update_game_info_with_turn_events() {
-        for (auto &bomb: game_info.bomb_map) {
-            bomb.second.timer--;
-            if (bomb.second.timer == 0) {
-                Event::BombExploded event = do_bomb_exploded(bomb.first, bomb.second);
-                game_info.turn_official_list.back().explosions[(uint32_t) game_info.turn_official_list.back().explosions.size()] = std::make_shared<Event::BombExploded>(
-                        event);
-            }
-        }
-        for (auto &explosion: game_info.turn_official_list.back().explosions) {
-            explosion.second->update_game_info(game_info);
-        }
-        for (auto &event: game_info.turn_working_list.back().events) {
-            event.second->update_game_info(game_info);
-        }
+    void catch_up_with_game(Connection::Batch &batch) {
+        if (game_info.is_running)
+            catch_up_with_running_game(batch);
+        else
+            catch_up_with_game_in_lobby(batch);
     }
 
-    void update_game_info_with_game_ended() {
-        game_info.is_running = false;
-        game_info.game_started_to_be_sent = false;
-        game_info.current_turn = 0;
-        game_info.player_position_map.clear();
-        game_info.player_score_map.clear();
-        game_info.players.clear();
-        game_info.players_working.clear();
-        game_info.turn_working_list.clear();
-        game_info.bomb_map.clear();
-        game_info.block_position_set.clear();
-        game_info.total_bomb_placed_count = 0;
-    }
-
-    void catch_up_with_running_game(batcp::socket *socket) {
-        std::cout << "gra juz chodzi\n";
-        bastreambuf streambuf_game_started;
-        Serialization::serialize_game_started_message(streambuf_game_started, game_info.players);
-        socket->send(streambuf_game_started.data());
-        // teraz wszystkie zalegle tury
-
-        for (auto turn: game_info.turn_official_list) {
-            bastreambuf streambuf_turn;
-            Serialization::serialize_turn_message(streambuf_turn, turn);
-            socket->send(streambuf_turn.data());
-            std::cout << "NADRABIAM I WYSLALEM TURE NR " << turn.nr << " rozmiaru "
-                      << turn.events.size() + turn.explosions.size() << "\n";
-        }
+    // Hello and everything the client has missed so far go out in one batch, after the frames
+    // already in it. Connecting the client on the game strand keeps it from missing or
+    // duplicating a broadcast.
+    void send_greeting(std::shared_ptr<Connection> &connection, Connection::Batch batch = {}) {
+        if (!game_info.hello_frame)
+            game_info.hello_frame = Serialization::serialize_hello_message(game_info);
+        batch.push_back(game_info.hello_frame);
+        catch_up_with_game(batch);
+        connection->post(std::move(batch));
+        connections.insert(connection);
     }
 
-    void catch_up_with_game_in_lobby(batcp::socket *socket) {
-        // game nie jest running, ale mogli juz dolaczyc jacys zawodnicy
-        if (game_info.players.size() > 0) {
-            // są już jacyś zawodnicy, powiadom o ich dołączeniu
-            for (auto player_pair: game_info.players) {
-                bastreambuf streambuf_player;
-                player_id_t player_id = player_pair.first;
-                Serialization::serialize_accepted_player_message(streambuf_player, player_id,
-                                                                 player_pair.second);
-                socket->send(streambuf_player.data());
-            }
-        }
+    // Runs on the game strand.
+    awaitable<void> leave(std::shared_ptr<Connection> connection) {
+        connections.erase(connection);
+        co_return;
     }
 
-    void catch_up_with_game(batcp::socket *socket) {
-        if (game_info.is_running)
-            catch_up_with_running_game(socket);
-        else
-            catch_up_with_game_in_lobby(socket);
-    }
-
-    void send_hello_message(batcp::socket *socket) {
-        socket->set_option(batcp::no_delay(true));
-        bastreambuf streambuf;
-        Serialization::serialize_hello_message(streambuf, game_info);
-        socket->send(streambuf.data());
-    }
-
-    awaitable<void> read_single_event(batcp::socket *socket, Buffer &buffer,
-                                      player_id_t &my_player_id) {
-        buffer.index = 0;
-        co_await Deserialization::receive_n_bytes(buffer, 1, socket);
-        if (buffer.get_message_code() == Message::RECEIVE_JOIN_MESSAGE_CODE) {
-            co_await do_join_message(socket, buffer, my_player_id);
-            if (game_info.enough_clients_joined())
-                game_info.game_started_to_be_sent = true;
-        } else if (buffer.get_message_code() == Message::RECEIVE_PLACE_BOMB_MESSAGE_CODE) {
-            co_await do_place_bomb_message(my_player_id);
-        } else if (buffer.get_message_code() == Message::RECEIVE_PLACE_BLOCK_MESSAGE_CODE) {
-            co_await do_place_block_message(my_player_id);
-        } else if (buffer.get_message_code() == Message::RECEIVE_MOVE_MESSAGE_CODE) {
-            co_await do_move_message(socket, buffer, my_player_id);
-        } else {
-            // todo - error i chyba rozłączenie
-            std::cerr << "INVALID MESSAGE FROM CLIENT\n";
-            exit(1);
-        }
+    // Runs on the game strand. A client coming over from another room gets GameEnded without
+    // scores first, which takes it back to the lobby whatever it has seen there.
+    awaitable<void> move_in(std::shared_ptr<Connection> connection) {
+        PlayerScoreMap no_scores;
+        send_greeting(connection,
+                      Connection::Batch{Serialization::serialize_game_ended_message(no_scores)});
         co_return;
     }
 
-    void prepare_turn(bastreambuf &streambuf) {
-        update_game_info_with_turn_events();
-        Serialization::serialize_turn_message(streambuf, game_info.turn_official_list.back());
+    void broadcast(FramePtr frame) {
+        for (auto &connection: connections)
+            connection->post(frame);
     }
 
-    void prepare_game_ended(bastreambuf &streambuf) {
-        Serialization::serialize_game_ended_message(streambuf, game_info.player_score_map);
+    // Runs on the game strand.
+    void do_action(Deserialization::ClientMessage &action) {
+        if (auto *bomb = std::get_if<Message::ReceivePlaceBombMessage>(&action))
+            engine.place_bomb(bomb->player_id);
+        else if (auto *block = std::get_if<Message::ReceivePlaceBlockMessage>(&action))
+            engine.place_block(block->player_id);
+        else if (auto *move = std::get_if<Message::ReceiveMoveMessage>(&action))
+            engine.move(move->player_id, move->direction);
+    }
+
+    // All the actions read in one go get to the game strand together.
+    void post_actions(std::vector <Deserialization::ClientMessage> &actions) {
+        if (actions.empty())
+            return;
+        boost::asio::post(game_strand, [this, actions = std::move(actions)]() mutable {
+            for (auto &action: actions)
+                do_action(action);
+        });
+        actions.clear();
+    }
+
+    FramePtr prepare_turn() {
+        std::optional <Trace::Span> simulate_span;
+        simulate_span.emplace(game_info.current_turn == 0 ? "prepare board" : "simulate", index);
+        Turn &turn = engine.play_turn();
+        simulate_span.reset();
+        Trace::Span serialize_span("serialize", index);
+        turn.frame = Serialization::serialize_turn_message(turn);
+        return turn.frame;
+    }
+
+    FramePtr prepare_game_ended() {
+        FramePtr frame = Serialization::serialize_game_ended_message(game_info.player_score_map);
         update_game_info_with_game_ended();
+        return frame;
     }
 
-    void send_new_accepted_player_messages(size_t &players_accepted_sent) {
-        if (game_info.players.size() > players_accepted_sent) {
-            while (players_accepted_sent < game_info.players.size()) {
+    void send_new_accepted_player_messages() {
+        // Każdy wysłany AcceptedPlayer zostaje w accepted_player_frames.
+        if (game_info.players.size() > game_info.accepted_player_frames.size()) {
+            while (game_info.accepted_player_frames.size() < game_info.players.size()) {
                 // serializuj i wysylaj player accepted
-                bastreambuf streambuf_accepted_player;
-                player_id_t player_id = (uint8_t) players_accepted_sent;
+                player_id_t player_id = (uint8_t) game_info.accepted_player_frames.size();
                 Player player(game_info.players[player_id].name,
                               game_info.players[player_id].address);
-                Serialization::serialize_accepted_player_message(streambuf_accepted_player,
-                                                                 player_id, player);
+                FramePtr frame = Serialization::serialize_accepted_player_message(player_id,
+                                                                                  player);
+                game_info.accepted_player_frames.push_back(frame);
                 // Niech każdy dowie się o dołączeniu tego zawodnika.
-                for (auto socket: sockets) {
-                    socket->send(streambuf_accepted_player.data());
-                }
-                players_accepted_sent++;
+                broadcast(frame);
             }
         }
     }
 
     awaitable<void> wait_time_duration() {
-        boost::asio::deadline_timer timer(co_await boost::asio::this_coro::executor,
-                                          boost::posix_time::milliseconds(game_info.turn_duration));
-        co_await
-        timer.async_wait(use_awaitable);
+        co_await tick_scheduler.wait();
         co_return;
     }
 
-    void create_space_for_following_turns() {
-        game_info.current_turn++;
-        game_info.turn_working_list.push_back(Turn(game_info.current_turn));
-        game_info.turn_official_list.push_back(Turn(game_info.current_turn));
+    void print_tick_stats() {
+        std::cout << "ROOM " << index << " ticks " << tick_scheduler.ticks << ", "
+                  << tick_scheduler.tick_rate() << "/s, overruns " << tick_scheduler.overruns
+                  << " (max " << std::chrono::duration_cast<std::chrono::microseconds>(
+                          tick_scheduler.max_overrun).count() << " us)\n";
     }
 
     void send_game_started() {
-        game_info.game_started_to_be_sent = false;
-        game_info.is_running = true;
-        game_info.current_turn = 0;
-        bastreambuf streambuf_game_started;
-        Serialization::serialize_game_started_message(streambuf_game_started,
-                                                      game_info.players);
-        for (auto socket: sockets)
-            socket->send(streambuf_game_started.data());
-
+        engine.start_game();
+        game_info.game_started_frame = Serialization::serialize_game_started_message(
+                game_info.players);
+        broadcast(game_info.game_started_frame);
     }
 
     void send_game_ended() {
-        bastreambuf streambuf;
-        prepare_game_ended(streambuf);
-        for (auto socket: sockets)
-            socket->send(streambuf.data());
+        broadcast(prepare_game_ended());
     }
 
     void send_turn() {
-        bastreambuf streambuf;
-        prepare_turn(streambuf);
-        for (auto socket: sockets) {
-            socket->send(streambuf.data());
-        }
+        FramePtr frame = prepare_turn();
+        Trace::Span span("broadcast", index);
+        Metrics::metrics.turn_bytes_sent.observe((double) (frame->bytes.size() * connections.size()));
+        broadcast(frame);
     }
 
     awaitable<void>
-    single_client_listener(batcp::socket socket) {
-        send_hello_message(&socket);
-        catch_up_with_game(&socket);
-        sockets.insert(&socket);
-        player_id_t my_player_id;
-        Buffer buffer;
+    all_clients_informer() {
         for (;;) {
-            co_await read_single_event(&socket, buffer, my_player_id);
+            co_await wait_time_duration();
+            Metrics::metrics.tick_overrun.observe(
+                    std::chrono::duration<double>(tick_scheduler.lateness).count());
+            auto tick_start = std::chrono::steady_clock::now();
+            bool game_ended = tick();
+            Metrics::metrics.tick_duration.observe(std::chrono::duration<double>(
+                    std::chrono::steady_clock::now() - tick_start).count());
+            active_bombs = game_info.bomb_map.size();
+            active_blocks = game_info.blocks.size();
+            if (game_ended) {
+                print_tick_stats();
+                Trace::tracer.dump_later();
+            }
         }
         co_return;
     }
 
+    // Everything done on one tick of the room. Returns whether the game has just ended.
+    bool tick() {
+        Trace::Span tick_span("tick", index);
+        {
+            Trace::Span span("accepted players", index);
+            send_new_accepted_player_messages();
+        }
+        if (game_info.game_started_to_be_sent) {
+            Trace::Span span("game started", index);
+            send_game_started();
+            return false;
+        }
+        // W lobby tury nie są rozgrywane.
+        if (!game_info.is_running)
+            return false;
+        send_turn();
+        {
+            Trace::Span span("snapshot", index);
+            take_snapshot_if_due();
+        }
+        if (game_info.last_turn_finished()) {
+            Trace::Span span("game ended", index);
+            send_game_ended();
+            return true;
+        }
+        engine.next_turn();
+        return false;
+    }
+
+
+};
+
+// Hands out clients to rooms. A connecting client watches the first room still waiting for
+// players, or the latest game on if there is no such room. Its Join puts it into a room waiting
+// for players, a new room is opened once all of them are full. Rooms are spread over the worker
+// threads, each one only ever runs on its own strand.
+struct Server {
+    ServerProgramParams::ServerProgramParams program_params;
+    boost::asio::io_context io_context;
+    std::vector <std::unique_ptr<Room>> rooms;
+    // Rooms are looked up and opened from the connections' strands and read by the metrics page.
+    std::mutex rooms_mutex;
+
+    Server(ServerProgramParams::ServerProgramParams &program_params) :
+            program_params(program_params), io_context(program_params.threads) {
+        Trace::tracer.enable(program_params.trace_file);
+    };
+
+    void dump_trace_on_signal(boost::asio::signal_set &signals) {
+        signals.async_wait([this, &signals](auto error, auto) {
+            if (error)
+                return;
+            Trace::tracer.dump_later();
+            dump_trace_on_signal(signals);
+        });
+    }
+
+    // Only called with rooms_mutex held.
+    Room *room_accepting_players() {
+        for (auto &room: rooms) {
+            if (room->accepting_players)
+                return room.get();
+        }
+        return nullptr;
+    }
+
+    Room &room_for_new_client() {
+        std::lock_guard <std::mutex> lock(rooms_mutex);
+        if (Room *room = room_accepting_players())
+            return *room;
+        // Spóźniony klient ogląda trwającą grę od zrzutu stanu i tur po nim.
+        if (!rooms.empty())
+            return *rooms.back();
+        return open_room();
+    }
+
+    Room &room_for_join() {
+        std::lock_guard <std::mutex> lock(rooms_mutex);
+        if (Room *room = room_accepting_players())
+            return *room;
+        return open_room();
+    }
+
+    // Only called with rooms_mutex held.
+    Room &open_room() {
+        // Każdy pokój losuje plansze z innego ziarna.
+        ServerProgramParams::ServerProgramParams room_params = program_params;
+        room_params.seed += (uint32_t) rooms.size();
+        rooms.push_back(std::make_unique<Room>(rooms.size(), room_params,
+                                               boost::asio::make_strand(io_context)));
+        Room &room = *rooms.back();
+        std::cout << "opened room " << room.index << "\n";
+        co_spawn(room.game_strand, room.all_clients_informer(), detached);
+        return room;
+    }
+
     awaitable<void> connections_listener() {
         auto executor = co_await
         boost::asio::this_coro::executor;
-        batcp::acceptor acceptor(executor, {batcp::v6(), port});
+        batcp::acceptor acceptor(executor, {batcp::v6(), program_params.port});
         for (;;) {
+            // Każde połączenie dostaje własny strand.
             batcp::socket socket =
                     co_await
-            acceptor.async_accept(use_awaitable);
+            acceptor.async_accept(boost::asio::make_strand(io_context), use_awaitable);
 
-            co_spawn(executor,
-                     single_client_listener(std::move(socket)),
-                     detached);
+            co_spawn(socket.get_executor(), single_client_listener(std::move(socket)), detached);
         }
         co_return;
     }
 
-    awaitable<void>
-    all_clients_informer() {
-        size_t players_accepted_sent = 0;
+    // Runs on the connection's strand.
+    Player receive_join_message(batcp::socket &socket, Message::ReceiveJoinMessage &message) {
+        std::string full_address = boost::lexical_cast<std::string>(socket.remote_endpoint());
+        AddressPair address(full_address);
+        return Player(message.name, address);
+    }
+
+    // Runs on the connection's strand. A Join reaching a room which is full or already playing
+    // moves the client over to a room waiting for players.
+    awaitable <player_id_t> join_game(Room *&room, std::shared_ptr<Connection> &connection,
+                                      Player player) {
         for (;;) {
-            co_await wait_time_duration();
-            std::cout << "____STARY_WSTAL\n";
-            send_new_accepted_player_messages(players_accepted_sent);
-            if (game_info.game_started_to_be_sent) {
-                send_game_started();
-                continue;
+            std::optional <player_id_t> id = co_await co_spawn(
+                    room->game_strand, room->join_game(player, connection), use_awaitable);
+            if (id)
+                co_return *id;
+            Room &lobby = room_for_join();
+            co_await co_spawn(room->game_strand, room->leave(connection), use_awaitable);
+            room = &lobby;
+            connection->room = room->index;
+            co_await co_spawn(room->game_strand, room->move_in(connection), use_awaitable);
+        }
+    }
+
+    // Messages are read and parsed on the connection's strand, only applying them to the game
+    // is handed over to the room's game strand. Actions sent before Join are ignored, an invalid
+    // message ends the connection.
+    awaitable<void> read_events(Room *&room, std::shared_ptr<Connection> &connection,
+                                Deserialization::MessageReader &reader,
+                                std::optional <player_id_t> &my_player_id) {
+        co_await reader.receive(connection->socket);
+        Trace::Span span("client read", room->index);
+        std::vector <Deserialization::ClientMessage> actions;
+        uint64_t parsed = 0;
+        while (auto message = reader.next(my_player_id.value_or(0))) {
+            parsed++;
+            if (auto *join = std::get_if<Message::ReceiveJoinMessage>(&*message)) {
+                room->post_actions(actions);
+                Player player = receive_join_message(connection->socket, *join);
+                my_player_id = co_await join_game(room, connection, std::move(player));
+            } else if (my_player_id) {
+                actions.push_back(std::move(*message));
             }
-            if (game_info.current_turn == 0) {
-                game_info.turn_working_list.push_back(Turn(game_info.current_turn));
-                game_info.turn_official_list.push_back(Turn(game_info.current_turn));
-                prepare_board();
-            } else {
-                game_info.turn_official_list.back() = game_info.turn_working_list.back();
+        }
+        room->post_actions(actions);
+        Metrics::metrics.messages_parsed += parsed;
+        co_return;
+    }
+
+    // Runs on the connection's strand.
+    awaitable<void>
+    single_client_listener(batcp::socket socket) {
+        Room *room = &room_for_new_client();
+        auto connection = std::make_shared<Connection>(std::move(socket), room->index);
+        Metrics::metrics.connected_sockets++;
+        co_spawn(connection->socket.get_executor(), send_queued_messages(connection), detached);
+        connection->socket.set_option(batcp::no_delay(true));
+        boost::asio::post(room->game_strand, [room, connection]() mutable {
+            room->send_greeting(connection);
+        });
+        std::optional <player_id_t> my_player_id;
+        Deserialization::MessageReader reader;
+        try {
+            for (;;) {
+                co_await read_events(room, connection, reader, my_player_id);
             }
-            send_turn();
-            std::cout << "TURN NR " << game_info.current_turn << "/" << game_info.game_length << "\n";
-            if (game_info.last_turn_finished())
-                send_game_ended();
-            create_space_for_following_turns();
+        } catch (std::exception &e) {
+            std::cerr << "client disconnected: " << e.what() << "\n";
         }
+        connection->close();
+        Metrics::metrics.connected_sockets--;
+        boost::asio::post(room->game_strand, [room, connection] {
+            room->connections.erase(connection);
+            room->joined_connections.erase(connection);
+        });
         co_return;
     }
 
+    std::string render_metrics() {
+        std::ostringstream out;
+        Metrics::metrics.render(out);
+        std::lock_guard <std::mutex> lock(rooms_mutex);
+        out << "# HELP robots_rooms Rooms opened so far.\n# TYPE robots_rooms gauge\n"
+            << "robots_rooms " << rooms.size() << "\n"
+            << "# HELP robots_active_bombs Bombs on the board.\n# TYPE robots_active_bombs gauge\n";
+        for (auto &room: rooms)
+            out << "robots_active_bombs{room=\"" << room->index << "\"} " << room->active_bombs << "\n";
+        out << "# HELP robots_active_blocks Blocks on the board.\n# TYPE robots_active_blocks gauge\n";
+        for (auto &room: rooms)
+            out << "robots_active_blocks{room=\"" << room->index << "\"} " << room->active_blocks << "\n";
+        return out.str();
+    }
 
-    void run() {
-        boost::asio::io_context io_context(1); // concurrency_hint?
+    // Answers every request with the metrics page, whatever it asked for.
+    awaitable<void> serve_metrics(batcp::socket socket) {
+        try {
+            bastreambuf request;
+            co_await boost::asio::async_read_until(socket, request, "\r\n\r\n", use_awaitable);
+            std::string body = render_metrics();
+            std::string response = "HTTP/1.1 200 OK\r\n"
+                                   "Content-Type: text/plain; version=0.0.4\r\n"
+                                   "Content-Length: " + std::to_string(body.size()) + "\r\n"
+                                   "Connection: close\r\n\r\n" + body;
+            co_await boost::asio::async_write(socket, boost::asio::buffer(response),
+                                              use_awaitable);
+        } catch (std::exception &e) {
+            std::cerr << "metrics request failed: " << e.what() << "\n";
+        }
+        co_return;
+    }
+
+    awaitable<void> metrics_listener() {
+        auto executor = co_await
+        boost::asio::this_coro::executor;
+        batcp::acceptor acceptor(executor, {boost::asio::ip::address_v4::loopback(),
+                                            program_params.metrics_port});
+        for (;;) {
+            batcp::socket socket = co_await acceptor.async_accept(use_awaitable);
+            co_spawn(executor, serve_metrics(std::move(socket)), detached);
+        }
+        co_return;
+    }
 
+    void run() {
         boost::asio::signal_set signals(io_context, SIGINT, SIGTERM);
         signals.async_wait([&](auto, auto) { io_context.stop(); });
+        boost::asio::signal_set trace_signals(io_context, SIGUSR1);
+        dump_trace_on_signal(trace_signals);
 
         co_spawn(io_context, connections_listener(), detached);
-        co_spawn(io_context, all_clients_informer(), detached);
+        if (program_params.metrics_port != 0)
+            co_spawn(boost::asio::make_strand(io_context), metrics_listener(), detached);
 
+        std::vector <std::thread> workers;
+        for (uint16_t i = 1; i < program_params.threads; ++i)
+            workers.emplace_back([this] { io_context.run(); });
         io_context.run();
+        for (auto &worker: workers)
+            worker.join();
     }
 
 };
@@ -413,9 +547,7 @@ int main(int argc, char **argv) {
                   << (uint32_t) std::chrono::system_clock::now().time_since_epoch().count() << "\n";
 
 
-        GameInfo game_info(program_params);
-
-        Server server(game_info, program_params.port);
+        Server server(program_params);
         server.run();
     } catch (std::exception &e) {
         std::cerr << "error: " << e.what() << "\n";
@@ -0,0 +1,432 @@
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <utility>
+#include <boost/asio.hpp>
+#include <boost/program_options.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <exception>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <optional>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "params_parsing.hpp"
+#include "writer.hpp"
+#include "reader.hpp"
+#include "protocol.hpp"
+
+// Load generator for robots-server: many clients in one process, without any GUI. Each one
+// connects, joins (again after every game), sends random actions at a given rate and decodes
+// everything the server sends. At the end it reports how long connecting took, how spread out
+// in time every Turn broadcast arrived at the clients of its game, and the traffic. The spread
+// is measured from the first client the Turn reached, not from the server's tick, so it's not
+// the latency: a tick sent late to everyone shows up in neither.
+
+using boost::asio::awaitable;
+using boost::asio::use_awaitable;
+using batcp = boost::asio::ip::tcp;
+using clock_type = std::chrono::steady_clock;
+
+struct SwarmParams {
+    ProgramParams::AddressPair server_address;
+    uint32_t connections;
+    double connect_rate;
+    double action_rate;
+    double duration;
+    uint16_t threads;
+    uint32_t seed;
+};
+
+static SwarmParams parse_swarm_params(int argc, char **argv) {
+    SwarmParams params;
+    std::string server_address;
+    boost::program_options::options_description desc("Allowed options");
+    desc.add_options()
+            ("help,h", "produce help message")
+            ("server-address,s",
+             boost::program_options::value<std::string>(&server_address)->required(),
+             "server-address")
+            ("connections,c",
+             boost::program_options::value<uint32_t>(&params.connections)->default_value(1000),
+             "number of clients")
+            ("connect-rate,r",
+             boost::program_options::value<double>(&params.connect_rate)->default_value(1000),
+             "new connections per second, 0 - all at once")
+            ("action-rate,a",
+             boost::program_options::value<double>(&params.action_rate)->default_value(10),
+             "actions per second of every client, 0 - none")
+            ("duration,d",
+             boost::program_options::value<double>(&params.duration)->default_value(10),
+             "seconds of the run")
+            ("threads,t",
+             boost::program_options::value<uint16_t>(&params.threads)->default_value(1),
+             "threads of the generator")
+            ("seed", boost::program_options::value<uint32_t>(&params.seed)->default_value(1),
+             "seed of the random actions");
+
+    boost::program_options::variables_map vm;
+    boost::program_options::store(boost::program_options::parse_command_line(argc, argv, desc),
+                                  vm);
+    if (vm.count("help")) {
+        std::cout << desc << "\n";
+        exit(0);
+    }
+    boost::program_options::notify(vm);
+    if (params.threads == 0 || params.connections == 0)
+        throw std::invalid_argument("invalid swarm parameters");
+    params.server_address = ProgramParams::parse_server_address(server_address);
+    return params;
+}
+
+// Totals of all clients, only read for the report printed every second.
+struct Progress {
+    std::atomic <uint64_t> connected{0};
+    std::atomic <uint64_t> failed{0};
+    std::atomic <uint64_t> bytes_received{0};
+    std::atomic <uint64_t> bytes_sent{0};
+    std::atomic <uint64_t> turns{0};
+};
+
+// Arrival of a Turn at a client. Game is identified by its roster, and by how many games with
+// this roster the client has seen before, the same for every client taking part.
+struct TurnArrival {
+    std::string game;
+    uint16_t turn;
+    clock_type::time_point time;
+};
+
+// One simulated client. Its socket lives in a Session owned by its coroutines, only what's
+// measured stays here, to be merged after the run.
+struct SwarmClient {
+    uint32_t index;
+    std::mt19937 random;
+    std::optional <clock_type::duration> connect_time;
+    std::vector <TurnArrival> arrivals;
+    std::map <std::string, uint32_t> games_seen;
+    std::string game;
+    uint64_t messages = 0;
+
+    SwarmClient(uint32_t index, uint32_t seed) : index(index), random(seed + index) {}
+
+    std::string name() const {
+        return "swarm" + std::to_string(index);
+    }
+
+    void on_game_started(Reader &reader) {
+        auto [players] = Protocol::GameStarted::read_body(reader);
+        std::string roster;
+        players.for_each([&roster](auto player) {
+            roster += std::get<1>(player);
+            roster += ',';
+        });
+        game = roster + std::to_string(games_seen[roster]++);
+    }
+
+    void skip_event(Reader &reader) {
+        uint8_t code = reader.u8();
+        if (code == Protocol::BombPlaced::code)
+            Protocol::BombPlaced::read_body(reader);
+        else if (code == Protocol::BombExploded::code)
+            Protocol::BombExploded::read_body(reader);
+        else if (code == Protocol::PlayerMoved::code)
+            Protocol::PlayerMoved::read_body(reader);
+        else if (code == Protocol::BlockPlaced::code)
+            Protocol::BlockPlaced::read_body(reader);
+        else
+            throw std::runtime_error("invalid event from server");
+    }
+
+    // Decodes one message, throws Incomplete if it hasn't fully arrived yet.
+    // Returns true for GameEnded, after which the client joins again.
+    bool decode(Reader &reader, clock_type::time_point now, Progress &progress) {
+        uint8_t code = reader.u8();
+        switch (code) {
+            case Protocol::Hello::code:
+                Protocol::Hello::read_body(reader);
+                break;
+            case Protocol::AcceptedPlayer::code:
+                Protocol::AcceptedPlayer::read_body(reader);
+                break;
+            case Protocol::GameStarted::code:
+                on_game_started(reader);
+                break;
+            case Protocol::TurnHeader::code: {
+                auto [turn, events] = Protocol::TurnHeader::read_body(reader);
+                for (uint32_t i = 0; i < events; ++i)
+                    skip_event(reader);
+                if (!game.empty()) {
+                    arrivals.push_back({game, turn, now});
+                    progress.turns++;
+                }
+                break;
+            }
+            case Protocol::GameEnded::code:
+                Protocol::GameEnded::read_body(reader);
+                game.clear();
+                return true;
+            case Protocol::Snapshot::code:
+                Protocol::Snapshot::read_body(reader);
+                break;
+            default:
+                throw std::runtime_error("invalid message from server");
+        }
+        return false;
+    }
+
+    // Socket of the client with its writer's state, shared by the reading and the writing
+    // coroutine. Only the writer sends, so messages never interleave.
+    struct Session {
+        batcp::socket socket;
+        boost::asio::steady_timer wake;
+        bool join_pending = true;
+        bool closed = false;
+
+        Session(const batcp::socket::executor_type &executor) : socket(executor),
+                                                                 wake(executor) {}
+    };
+
+    template<typename M, typename... Ts>
+    awaitable<void> send(Session &session, Progress &progress, const Ts &... values) {
+        Writer writer = M::encode(values...);
+        co_await boost::asio::async_write(session.socket, boost::asio::buffer(writer.finish()),
+                                          use_awaitable);
+        progress.bytes_sent += writer.bytes.size();
+    }
+
+    // Joins whenever asked to, sends random actions in between.
+    awaitable<void> write(std::shared_ptr<Session> session, double action_rate,
+                          Progress &progress) {
+        std::exponential_distribution<double> interval(action_rate > 0 ? action_rate : 1);
+        auto next_interval = [&] {
+            return std::chrono::duration_cast<clock_type::duration>(
+                    std::chrono::duration<double>(interval(random)));
+        };
+        clock_type::time_point next_action = action_rate > 0 ? clock_type::now() + next_interval()
+                                                             : clock_type::time_point::max();
+        try {
+            while (!session->closed) {
+                if (session->join_pending) {
+                    session->join_pending = false;
+                    co_await send<Protocol::Join>(*session, progress, name());
+                    continue;
+                }
+                session->wake.expires_at(next_action);
+                boost::system::error_code ignored;
+                co_await session->wake.async_wait(
+                        boost::asio::redirect_error(use_awaitable, ignored));
+                if (session->closed || session->join_pending || clock_type::now() < next_action)
+                    continue;
+                next_action += next_interval();
+                uint32_t roll = (uint32_t) (random() % 10);
+                if (roll < 7)
+                    co_await send<Protocol::Move>(*session, progress, (uint8_t) (roll % 4));
+                else if (roll < 9)
+                    co_await send<Protocol::PlaceBomb>(*session, progress);
+                else
+                    co_await send<Protocol::PlaceBlock>(*session, progress);
+            }
+        } catch (std::exception &e) {
+            std::cerr << name() << ": " << e.what() << "\n";
+        }
+    }
+
+    awaitable<void> read(Session &session, Progress &progress) {
+        std::vector<char> data(64 * 1024);
+        size_t begin = 0;
+        size_t end = 0;
+        for (;;) {
+            if (begin == end) {
+                begin = end = 0;
+            } else if (begin > 0) {
+                memmove(data.data(), data.data() + begin, end - begin);
+                end -= begin;
+                begin = 0;
+            }
+            if (end == data.size())
+                data.resize(2 * data.size());
+            size_t read = co_await session.socket.async_read_some(
+                    boost::asio::buffer(data.data() + end, data.size() - end), use_awaitable);
+            end += read;
+            progress.bytes_received += read;
+            clock_type::time_point now = clock_type::now();
+            for (;;) {
+                Reader reader(data.data() + begin, end - begin);
+                bool game_ended;
+                try {
+                    game_ended = decode(reader, now, progress);
+                } catch (Incomplete &) {
+                    break;
+                }
+                begin += reader.index;
+                messages++;
+                if (game_ended) {
+                    session.join_pending = true;
+                    session.wake.cancel();
+                }
+            }
+        }
+    }
+
+    awaitable<void> run(batcp::resolver::results_type endpoints, double action_rate,
+                        Progress &progress) {
+        auto executor = co_await boost::asio::this_coro::executor;
+        auto session = std::make_shared<Session>(executor);
+        try {
+            clock_type::time_point start = clock_type::now();
+            co_await boost::asio::async_connect(session->socket, endpoints, use_awaitable);
+            connect_time = clock_type::now() - start;
+            progress.connected++;
+            session->socket.set_option(batcp::no_delay(true));
+            boost::asio::co_spawn(executor, write(session, action_rate, progress),
+                                  boost::asio::detached);
+            co_await read(*session, progress);
+        } catch (std::exception &e) {
+            if (!connect_time)
+                progress.failed++;
+            std::cerr << name() << ": " << e.what() << "\n";
+        }
+        session->closed = true;
+        session->wake.cancel();
+        boost::system::error_code ignored;
+        session->socket.close(ignored);
+    }
+};
+
+// Starts the clients evenly spread over time, connect_rate of them per second.
+static awaitable<void>
+start_clients(boost::asio::io_context &io_context, std::vector <std::unique_ptr<SwarmClient>> &clients,
+              SwarmParams &params, batcp::resolver::results_type endpoints, Progress &progress,
+              clock_type::time_point start) {
+    boost::asio::steady_timer timer(io_context);
+    for (auto &client: clients) {
+        if (params.connect_rate > 0) {
+            timer.expires_at(start + std::chrono::duration_cast<clock_type::duration>(
+                    std::chrono::duration<double>(client->index / params.connect_rate)));
+            co_await timer.async_wait(use_awaitable);
+        }
+        boost::asio::co_spawn(boost::asio::make_strand(io_context),
+                              client->run(endpoints, params.action_rate, progress),
+                              boost::asio::detached);
+    }
+}
+
+static double milliseconds(clock_type::duration duration) {
+    return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+static void print_distribution(const std::string &what, std::vector <clock_type::duration> &values) {
+    std::cout << what << ": ";
+    if (values.empty()) {
+        std::cout << "none\n";
+        return;
+    }
+    std::sort(values.begin(), values.end());
+    auto percentile = [&values](double p) {
+        return milliseconds(values[(size_t) (p * (double) (values.size() - 1))]);
+    };
+    std::cout << std::fixed << std::setprecision(3) << values.size() << " samples, p50 "
+              << percentile(0.5) << " ms, p90 " << percentile(0.9) << " ms, p99 "
+              << percentile(0.99) << " ms, max " << milliseconds(values.back()) << " ms\n";
+}
+
+// Every arrival minus the earliest arrival of the same Turn of the same game. The server doesn't
+// say when it ticked, so this is how unevenly a broadcast reaches the clients, not its latency.
+static std::vector <clock_type::duration>
+broadcast_spread(std::vector <std::unique_ptr<SwarmClient>> &clients) {
+    std::map <std::pair<std::string, uint16_t>, std::vector<clock_type::time_point>> turns;
+    for (auto &client: clients) {
+        for (auto &arrival: client->arrivals)
+            turns[{arrival.game, arrival.turn}].push_back(arrival.time);
+    }
+    std::vector <clock_type::duration> spread;
+    for (auto &[turn, times]: turns) {
+        clock_type::time_point first = *std::min_element(times.begin(), times.end());
+        for (auto time: times)
+            spread.push_back(time - first);
+    }
+    return spread;
+}
+
+int main(int argc, char **argv) {
+    try {
+        SwarmParams params = parse_swarm_params(argc, argv);
+        boost::asio::io_context io_context((int) params.threads);
+        batcp::resolver resolver(io_context);
+        batcp::resolver::results_type endpoints = resolver.resolve(params.server_address.host,
+                                                                   params.server_address.port);
+        Progress progress;
+        std::vector <std::unique_ptr<SwarmClient>> clients;
+        for (uint32_t i = 0; i < params.connections; ++i)
+            clients.push_back(std::make_unique<SwarmClient>(i, params.seed));
+
+        clock_type::time_point start = clock_type::now();
+        boost::asio::co_spawn(io_context, start_clients(io_context, clients, params, endpoints,
+                                                        progress, start),
+                              boost::asio::detached);
+
+        boost::asio::steady_timer report_timer(io_context);
+        uint64_t last_received = 0;
+        std::function<void(boost::system::error_code)> report = [&](auto error) {
+            if (error)
+                return;
+            uint64_t received = progress.bytes_received;
+            std::cout << std::fixed << std::setprecision(1)
+                      << milliseconds(clock_type::now() - start) / 1000 << " s: connected "
+                      << progress.connected << ", turns " << progress.turns << ", "
+                      << (double) (received - last_received) / 1024 << " KiB/s in\n";
+            last_received = received;
+            if (clock_type::now() - start >= std::chrono::duration<double>(params.duration)) {
+                io_context.stop();
+                return;
+            }
+            report_timer.expires_at(report_timer.expiry() + std::chrono::seconds(1));
+            report_timer.async_wait(report);
+        };
+        report_timer.expires_after(std::chrono::seconds(1));
+        report_timer.async_wait(report);
+
+        std::vector <std::thread> workers;
+        for (uint16_t i = 1; i < params.threads; ++i)
+            workers.emplace_back([&io_context] { io_context.run(); });
+        io_context.run();
+        for (auto &worker: workers)
+            worker.join();
+        double seconds = milliseconds(clock_type::now() - start) / 1000;
+
+        std::vector <clock_type::duration> connect_times;
+        uint64_t messages = 0;
+        for (auto &client: clients) {
+            if (client->connect_time)
+                connect_times.push_back(*client->connect_time);
+            messages += client->messages;
+        }
+        std::vector <clock_type::duration> spread = broadcast_spread(clients);
+
+        std::cout << "connections: " << progress.connected << " of " << params.connections
+                  << " established, " << progress.failed << " failed\n";
+        print_distribution("connect time", connect_times);
+        print_distribution("turn arrival after the game's first receiver (spread, not latency)",
+                           spread);
+        std::cout << std::fixed << std::setprecision(1) << "received "
+                  << (double) progress.bytes_received / seconds / 1024 << " KiB/s, "
+                  << (double) messages / seconds << " messages/s, sent "
+                  << (double) progress.bytes_sent / seconds / 1024 << " KiB/s\n";
+    } catch (std::exception &e) {
+        std::cerr << "error: " << e.what() << "\n";
+        exit(1);
+    }
+    return 0;
+}
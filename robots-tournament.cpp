@@ -0,0 +1,188 @@
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/program_options.hpp>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <exception>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <thread>
+#include <variant>
+#include <array>
+#include <cstring>
+#include <stdexcept>
+#include <memory>
+
+#include "server-params-parsing.hpp"
+#include "declarations.hpp"
+#include "board.hpp"
+#include "writer.hpp"
+#include "reader.hpp"
+#include "protocol.hpp"
+#include "includes.hpp"
+#include "server-deserialization.hpp"
+#include "server-serialization.hpp"
+#include "server-engine.hpp"
+#include "server-bots.hpp"
+
+// Plays many seeded games between in-process bots, without sockets or timers, on all cores.
+// Game i uses seed + i, so any single game can be replayed on its own, and the results don't
+// depend on the number of threads.
+
+namespace po = boost::program_options;
+
+struct TournamentParams {
+    uint16_t size_x;
+    uint16_t size_y;
+    uint16_t game_length;
+    uint16_t bomb_timer;
+    uint16_t explosion_radius;
+    uint16_t initial_blocks;
+    uint32_t games;
+    uint32_t seed;
+    uint16_t threads;
+    std::vector <std::string> bots;
+    std::string output;
+    bool quiet;
+};
+
+static TournamentParams parse_tournament_params(int argc, char **argv) {
+    TournamentParams params;
+    std::string bots;
+    po::options_description desc("Options");
+    desc.add_options()
+            ("help,h", "Print help information")
+            ("bots,B", po::value<std::string>(&bots)->required(),
+             "Comma separated strategies of the players: random, idle, bomber, dodger")
+            ("games,g", po::value<uint32_t>(&params.games)->default_value(1000))
+            ("seed,s", po::value<uint32_t>(&params.seed)->default_value(1),
+             "Seed of the first game, game i is played with seed + i")
+            ("threads,t", po::value<uint16_t>(&params.threads)->default_value(
+                    (uint16_t) std::max(1u, std::thread::hardware_concurrency())))
+            ("size-x,x", po::value<uint16_t>(&params.size_x)->default_value(20))
+            ("size-y,y", po::value<uint16_t>(&params.size_y)->default_value(20))
+            ("game-length,l", po::value<uint16_t>(&params.game_length)->default_value(100))
+            ("bomb-timer,b", po::value<uint16_t>(&params.bomb_timer)->default_value(5))
+            ("explosion-radius,e", po::value<uint16_t>(&params.explosion_radius)->default_value(4))
+            ("initial-blocks,k", po::value<uint16_t>(&params.initial_blocks)->default_value(40))
+            ("output,o", po::value<std::string>(&params.output),
+             "File for GameEnded messages of all the games, in game order")
+            ("quiet,q", po::bool_switch(&params.quiet), "Only print the summary");
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    if (vm.count("help")) {
+        std::cout << desc << "\n";
+        exit(0);
+    }
+    po::notify(vm);
+    boost::split(params.bots, bots, boost::is_any_of(","));
+    if (params.bots.empty() || params.bots.size() > 255 || params.size_x == 0 ||
+        params.size_y == 0 || params.threads == 0)
+        throw std::invalid_argument("invalid tournament parameters");
+    // Nieznana strategia ma wyjść przed rozpoczęciem gier.
+    for (auto &bot: params.bots)
+        Bots::make_bot(bot, 1);
+    return params;
+}
+
+// Scores (deaths) of one game, as in its GameEnded message.
+static PlayerScoreMap play_game(TournamentParams &params, uint32_t seed) {
+    ServerProgramParams::ServerProgramParams program_params(
+            params.bomb_timer, (uint16_t) params.bots.size(), 0, params.explosion_radius,
+            params.initial_blocks, params.game_length, "tournament", 0, params.size_x,
+            params.size_y, seed);
+    GameInfo game_info(program_params);
+    Engine engine(game_info);
+    std::vector <Bots::Bot> bots;
+    // Generatory botów muszą startować od niezerowego stanu.
+    for (uint32_t i = 0; i < params.bots.size(); ++i)
+        bots.push_back(Bots::make_bot(params.bots[i], (seed % 2147483646u) + 1 + i));
+
+    engine.start_game();
+    for (;;) {
+        if (game_info.current_turn > 0) {
+            for (player_id_t id = 0; id < game_info.players_count; ++id)
+                bots[id](engine, id);
+        }
+        engine.play_turn();
+        if (game_info.last_turn_finished())
+            break;
+        engine.next_turn();
+    }
+    return game_info.player_score_map;
+}
+
+int main(int argc, char **argv) {
+    try {
+        TournamentParams params = parse_tournament_params(argc, argv);
+        std::vector <PlayerScoreMap> results(params.games);
+
+        auto start = std::chrono::steady_clock::now();
+        std::atomic <uint32_t> next_game{0};
+        std::vector <std::thread> workers;
+        for (uint16_t i = 0; i < params.threads; ++i) {
+            workers.emplace_back([&params, &results, &next_game] {
+                for (uint32_t game; (game = next_game++) < params.games;)
+                    results[game] = play_game(params, params.seed + game);
+            });
+        }
+        for (auto &worker: workers)
+            worker.join();
+        double seconds = std::chrono::duration<double>(
+                std::chrono::steady_clock::now() - start).count();
+
+        std::ofstream output;
+        if (!params.output.empty()) {
+            output.open(params.output, std::ios::binary);
+            if (!output)
+                throw std::runtime_error("cannot open " + params.output);
+        }
+        std::vector <uint64_t> total_deaths(params.bots.size(), 0);
+        std::vector <uint32_t> wins(params.bots.size(), 0);
+        for (uint32_t game = 0; game < params.games; ++game) {
+            PlayerScoreMap &scores = results[game];
+            if (output.is_open()) {
+                FramePtr frame = Serialization::serialize_game_ended_message(scores);
+                output.write(frame->bytes.data(), (std::streamsize) frame->bytes.size());
+            }
+            score_t fewest_deaths = UINT32_MAX;
+            for (auto &[id, score]: scores) {
+                total_deaths[id] += score;
+                fewest_deaths = std::min(fewest_deaths, score);
+            }
+            // Wygrywają wszyscy z najmniejszą liczbą śmierci.
+            for (auto &[id, score]: scores) {
+                if (score == fewest_deaths)
+                    wins[id]++;
+            }
+            if (params.quiet)
+                continue;
+            std::cout << "game " << game << " seed " << params.seed + game;
+            for (auto &[id, score]: scores)
+                std::cout << " | " << (uint32_t) id << " " << params.bots[id] << " " << score;
+            std::cout << "\n";
+        }
+
+        std::cout << params.games << " games in " << std::fixed << std::setprecision(2)
+                  << seconds << " s on " << params.threads << " threads\n";
+        for (size_t id = 0; id < params.bots.size(); ++id) {
+            std::cout << id << " " << params.bots[id] << ": deaths/game "
+                      << (double) total_deaths[id] / (double) params.games << ", wins "
+                      << wins[id] << "\n";
+        }
+    } catch (std::exception &e) {
+        std::cerr << "error: " << e.what() << "\n";
+        exit(1);
+    }
+    return 0;
+}
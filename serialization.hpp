@@ -1,143 +1,99 @@
 namespace Serialization {
-    void serialize(uint8_t number, boost::asio::streambuf &streambuf) {
-        streambuf.sputn((const char *) &number, sizeof(number));
+    auto players_entries(PlayersArray &players) {
+        return Protocol::mapped(players, [](const auto &player) {
+            return std::tie(player.first, player.second.name, player.second.address);
+        });
     }
 
-    void serialize(uint16_t number, boost::asio::streambuf &streambuf) {
-        uint16_t number_be = htons(number);
-        streambuf.sputn((const char *) &number_be, sizeof(number_be));
-    }
-
-    void serialize(uint32_t number, boost::asio::streambuf &streambuf) {
-        uint32_t number_be = htonl(number);
-        streambuf.sputn((const char *) &number_be, sizeof(number_be));
-    }
-
-    void serialize(std::string &str, boost::asio::streambuf &streambuf) {
-        uint8_t length = (uint8_t) str.size();
-        serialize(length, streambuf);
-        streambuf.sputn((const char *) str.data(), length);
-    }
-
-    void serialize_position(const Position &position, boost::asio::streambuf &streambuf) {
-        serialize(position.x, streambuf);
-        serialize(position.y, streambuf);
-    }
-
-    void serialize(PlayersMap &players, boost::asio::streambuf &streambuf) {
-        serialize((uint32_t) players.size(), streambuf);
-
-        for (auto &player: players) {
-            serialize((uint8_t) player.first, streambuf);
-            serialize(player.second.name, streambuf);
-            serialize(player.second.address, streambuf);
-        }
-    }
-
-    void serialize(PositionsMap &player_positions, boost::asio::streambuf &streambuf) {
-        serialize((uint32_t) player_positions.size(), streambuf);
-
-        for (auto &position: player_positions) {
-            serialize((uint8_t) position.first, streambuf);
-            serialize_position(position.second, streambuf);
-        }
-    }
-
-    void serialize(ScoresMap &scores, boost::asio::streambuf &streambuf) {
-        serialize((uint32_t) scores.size(), streambuf);
-
-        for (auto &player_score: scores) {
-            serialize((uint8_t) player_score.first, streambuf);
-            serialize(player_score.second, streambuf);
+    // One datagram if the message fits in it, otherwise GuiChunk headers each followed by as
+    // much of the message as fits, sent straight from the message's buffer.
+    boost::asio::awaitable<void> send_to_gui(boost::asio::ip::udp::socket *socket,
+                                             boost::asio::ip::udp::endpoint &gui_endpoint,
+                                             GameInfo &game_info, Writer &writer) {
+        std::vector<char> &message = writer.finish();
+        uint32_t number = game_info.gui_messages_sent++;
+        if (message.size() <= game_info.gui_max_datagram) {
+            co_await
+            socket->async_send_to(boost::asio::buffer(message), gui_endpoint,
+                                  boost::asio::use_awaitable);
+            co_return;
         }
-    }
-
-    void serialize(std::map <uint32_t, Bomb> &bombs, boost::asio::streambuf &streambuf) {
-        serialize((uint32_t) bombs.size(), streambuf);
-
-        for (auto &bomb: bombs) {
-            serialize_position(bomb.second.position, streambuf);
-            serialize(bomb.second.timer, streambuf);
+        size_t piece_size = game_info.gui_max_datagram - Protocol::GuiChunk::min_size;
+        size_t chunks = (message.size() + piece_size - 1) / piece_size;
+        if (chunks > UINT16_MAX)
+            throw std::runtime_error("GUI message too long");
+        for (size_t chunk = 0; chunk < chunks; ++chunk) {
+            Writer header = Protocol::GuiChunk::encode(game_info.turn, number, chunk, chunks);
+            size_t begin = chunk * piece_size;
+            std::array<boost::asio::const_buffer, 2> buffers{
+                    boost::asio::buffer(header.finish()),
+                    boost::asio::buffer(message.data() + begin,
+                                        std::min(piece_size, message.size() - begin))};
+            co_await socket->async_send_to(buffers, gui_endpoint, boost::asio::use_awaitable);
         }
-    }
-
-    void serialize(std::set <Position> &positions,
-                   boost::asio::streambuf &streambuf) {
-        serialize((uint32_t) positions.size(), streambuf);
-
-        for (auto &position: positions)
-            serialize_position(position, streambuf);
+        co_return;
     }
 
     boost::asio::awaitable<void> send_lobby_message(boost::asio::ip::udp::socket *socket,
                                                     boost::asio::ip::udp::endpoint &gui_endpoint,
                                                     GameInfo &game_info) {
-        boost::asio::streambuf streambuf;
-        serialize((uint8_t) LOBBY_MESSAGE_TO_GUI, streambuf); // Message code.
-        serialize(game_info.server_name, streambuf);
-        serialize(game_info.players_count, streambuf);
-        serialize(game_info.size_x, streambuf);
-        serialize(game_info.size_y, streambuf);
-        serialize(game_info.game_length, streambuf);
-        serialize(game_info.explosion_radius, streambuf);
-        serialize(game_info.bomb_timer, streambuf);
-        serialize(game_info.players, streambuf);
-        co_await
-        socket->async_send_to(streambuf.data(), gui_endpoint, boost::asio::use_awaitable);
+        Writer writer = Protocol::Lobby::encode(
+                game_info.server_name, game_info.players_count, game_info.size_x,
+                game_info.size_y, game_info.game_length, game_info.explosion_radius,
+                game_info.bomb_timer, players_entries(game_info.players));
+        co_await send_to_gui(socket, gui_endpoint, game_info, writer);
         co_return;
     }
 
     boost::asio::awaitable<void> send_game_message(boost::asio::ip::udp::socket *socket,
                                                    boost::asio::ip::udp::endpoint &gui_endpoint,
                                                    GameInfo &game_info) {
-        boost::asio::streambuf streambuf;
-        serialize((uint8_t) GAME_MESSAGE_TO_GUI, streambuf); // Message code.
-        serialize(game_info.server_name, streambuf);
-        serialize(game_info.size_x, streambuf);
-        serialize(game_info.size_y, streambuf);
-        serialize(game_info.game_length, streambuf);
-        serialize(game_info.turn, streambuf);
-        serialize(game_info.players, streambuf);
-        serialize(game_info.player_positions, streambuf);
-        serialize(game_info.blocks, streambuf);
-        serialize(game_info.bombs, streambuf);
-        serialize(game_info.explosions, streambuf);
-        serialize(game_info.scores, streambuf);
-        co_await
-        socket->async_send_to(streambuf.data(), gui_endpoint, boost::asio::use_awaitable);
+        uint16_t turn = game_info.turn;
+        Writer writer = Protocol::Game::encode(
+                game_info.server_name, game_info.size_x, game_info.size_y,
+                game_info.game_length, game_info.turn, players_entries(game_info.players),
+                game_info.player_positions, game_info.blocks,
+                Protocol::mapped(game_info.bombs, [turn](const auto &bomb) {
+                    return std::make_tuple(bomb.second.position,
+                                           (uint16_t) (bomb.second.explosion_turn - turn));
+                }),
+                game_info.explosions, game_info.scores);
+        co_await send_to_gui(socket, gui_endpoint, game_info, writer);
         co_return;
     }
 
-    // PlaceBomb, PlaceBlock.
-    boost::asio::awaitable<void>
-    send_message_to_server(boost::asio::ip::tcp::socket *socket, uint8_t code) {
-        boost::asio::streambuf streambuf;
-        serialize(code, streambuf);
-        co_await
-        socket->async_send(streambuf.data(), boost::asio::use_awaitable);
-    }
-
-    // Join.
+    // Only what changed since the last Game or GameDelta message, see Protocol::GameDelta.
     boost::asio::awaitable<void>
-    send_message_to_server(boost::asio::ip::tcp::socket *socket, uint8_t code,
-                           std::string &name) {
-        boost::asio::streambuf streambuf;
-        serialize(code, streambuf);
-        serialize(name, streambuf);
-        co_await
-        socket->async_send(streambuf.data(), boost::asio::use_awaitable);
+    send_game_delta_message(boost::asio::ip::udp::socket *socket,
+                            boost::asio::ip::udp::endpoint &gui_endpoint, GameInfo &game_info) {
+        uint16_t turn = game_info.turn;
+        GuiDelta &delta = game_info.gui_delta;
+        std::vector <std::tuple<Position, uint16_t>> bombs_added;
+        for (bomb_id_t id: delta.bombs_added) {
+            Bomb *bomb = game_info.bombs.find(id);
+            bombs_added.emplace_back(bomb->position, (uint16_t) (bomb->explosion_turn - turn));
+        }
+        Writer writer = Protocol::GameDelta::encode(
+                delta.base_turn.value(), turn,
+                Protocol::mapped(delta.moved, [&game_info](player_id_t id) {
+                    return std::make_tuple(id, game_info.player_positions.at(id));
+                }),
+                delta.blocks_removed, delta.blocks_added, delta.bombs_removed, bombs_added,
+                game_info.explosions,
+                Protocol::mapped(delta.scores_changed, [&game_info](player_id_t id) {
+                    return std::make_tuple(id, game_info.scores.at(id));
+                }));
+        co_await send_to_gui(socket, gui_endpoint, game_info, writer);
         co_return;
     }
 
-    // Move.
+    // Join, PlaceBomb, PlaceBlock, Move.
+    template<typename M, typename... Ts>
     boost::asio::awaitable<void>
-    send_message_to_server(boost::asio::ip::tcp::socket *socket, uint8_t code,
-                           uint8_t direction) {
-        boost::asio::streambuf streambuf;
-        serialize(code, streambuf);
-        serialize(direction, streambuf);
+    send_to_server(boost::asio::ip::tcp::socket *socket, const Ts &... values) {
+        Writer writer = M::encode(values...);
         co_await
-        socket->async_send(streambuf.data(), boost::asio::use_awaitable);
+        socket->async_send(boost::asio::buffer(writer.finish()), boost::asio::use_awaitable);
         co_return;
     }
 }
@@ -0,0 +1,86 @@
+#include <functional>
+
+// Players living in the same process as the engine, for the benchmark and the tournament runner.
+// A bot is called once every turn after turn 0 and acts through the engine like a client would,
+// it may look at everything in engine.game_info. Every bot draws from its own generator, so
+// a game depends only on its seed and the bots taking part.
+namespace Bots {
+    using Bot = std::function<void(Engine &engine, player_id_t id)>;
+
+    // Each turn a move (70%), a bomb (15%), a block (5%) or nothing.
+    Bot random_bot(uint32_t seed) {
+        return [generator = RandomNumberGenerator{seed}](Engine &engine, player_id_t id) mutable {
+            uint32_t roll = generator.generate() % 20;
+            if (roll < 14)
+                engine.move(id, (uint8_t) (roll % 4));
+            else if (roll < 17)
+                engine.place_bomb(id);
+            else if (roll < 18)
+                engine.place_block(id);
+        };
+    }
+
+    // Never does anything.
+    Bot idle_bot(uint32_t) {
+        return [](Engine &, player_id_t) {};
+    }
+
+    // Places a bomb, then runs straight in a random direction for a few turns.
+    Bot bomber_bot(uint32_t seed) {
+        return [generator = RandomNumberGenerator{seed}, direction = (uint8_t) 0,
+                steps_left = 0](Engine &engine, player_id_t id) mutable {
+            if (steps_left == 0) {
+                engine.place_bomb(id);
+                direction = (uint8_t) (generator.generate() % 4);
+                steps_left = 3;
+                return;
+            }
+            engine.move(id, direction);
+            steps_left--;
+        };
+    }
+
+    // Steps off the row or column of any bomb which would reach it, wanders around otherwise.
+    Bot dodger_bot(uint32_t seed) {
+        return [generator = RandomNumberGenerator{seed}](Engine &engine, player_id_t id) mutable {
+            GameInfo &game_info = engine.game_info;
+            Position &position = game_info.player_position_map[id];
+            bool in_row = false;
+            bool in_column = false;
+            for (auto &[bomb_id, bomb]: game_info.bomb_map) {
+                if (bomb.position.y == position.y &&
+                    std::abs(bomb.position.x - position.x) <= game_info.explosion_radius)
+                    in_row = true;
+                if (bomb.position.x == position.x &&
+                    std::abs(bomb.position.y - position.y) <= game_info.explosion_radius)
+                    in_column = true;
+            }
+            uint32_t roll = generator.generate();
+            if (in_row && !in_column)
+                engine.move(id, roll % 2 ? Deserialization::UP : Deserialization::DOWN);
+            else if (in_column && !in_row)
+                engine.move(id, roll % 2 ? Deserialization::RIGHT : Deserialization::LEFT);
+            else if (in_row)
+                engine.move(id, (uint8_t) (roll % 4));
+            else if (roll % 10 == 0)
+                engine.place_bomb(id);
+            else
+                engine.move(id, (uint8_t) (roll % 4));
+        };
+    }
+
+    const std::vector <std::pair<std::string, Bot (*)(uint32_t)>> strategies = {
+            {"random", random_bot},
+            {"idle",   idle_bot},
+            {"bomber", bomber_bot},
+            {"dodger", dodger_bot},
+    };
+
+    Bot make_bot(const std::string &strategy, uint32_t seed) {
+        for (auto &[name, make]: strategies) {
+            if (name == strategy)
+                return make(seed);
+        }
+        throw std::invalid_argument("unknown bot strategy " + strategy);
+    }
+}
@@ -0,0 +1,91 @@
+// Outbound side of a single client connection. Every message is serialized once by the server
+// and only a reference to its frame is queued here, the queue is drained by the connection's own
+// writer coroutine, so a slow client doesn't stall the turn broadcast for everyone else.
+// The socket lives on the connection's own strand, every method below has to be called there.
+struct Connection : std::enable_shared_from_this<Connection> {
+    // A client lagging this many messages behind is considered dead and gets disconnected.
+    static constexpr size_t MAX_QUEUED_MESSAGES = 256;
+
+    // Frames queued together are sent with a single gather write.
+    using Batch = std::vector<FramePtr>;
+
+    boost::asio::ip::tcp::socket socket;
+    // Index of the room, only for tracing.
+    size_t room;
+    boost::asio::steady_timer queue_notifier;
+    std::deque <Batch> send_queue;
+    bool closed = false;
+
+    Connection(boost::asio::ip::tcp::socket socket, size_t room) :
+            socket(std::move(socket)), room(room), queue_notifier(this->socket.get_executor()) {
+        // The timer never expires by itself, it's only cancelled to wake the writer up.
+        queue_notifier.expires_at(std::chrono::steady_clock::time_point::max());
+    }
+
+    void enqueue(Batch batch) {
+        if (closed)
+            return;
+        if (send_queue.size() >= MAX_QUEUED_MESSAGES) {
+            std::cerr << "client is too slow, disconnecting\n";
+            close();
+            return;
+        }
+        send_queue.push_back(std::move(batch));
+        Metrics::metrics.send_queue_depth.observe((double) send_queue.size());
+        queue_notifier.cancel();
+    }
+
+    void enqueue(FramePtr frame) {
+        enqueue(Batch{std::move(frame)});
+    }
+
+    // Enqueues the batch from any thread, e.g. from the game strand.
+    void post(Batch batch) {
+        boost::asio::post(socket.get_executor(),
+                          [self = shared_from_this(), batch = std::move(batch)]() mutable {
+                              self->enqueue(std::move(batch));
+                          });
+    }
+
+    void post(FramePtr frame) {
+        post(Batch{std::move(frame)});
+    }
+
+    void close() {
+        if (closed)
+            return;
+        closed = true;
+        send_queue.clear();
+        boost::system::error_code ignored;
+        socket.close(ignored);
+        queue_notifier.cancel();
+    }
+};
+
+boost::asio::awaitable<void> send_queued_messages(std::shared_ptr <Connection> connection) {
+    try {
+        while (!connection->closed) {
+            if (connection->send_queue.empty()) {
+                boost::system::error_code ignored;
+                co_await connection->queue_notifier.async_wait(
+                        boost::asio::redirect_error(boost::asio::use_awaitable, ignored));
+                continue;
+            }
+            Connection::Batch batch = connection->send_queue.front();
+            std::vector <boost::asio::const_buffer> buffers;
+            buffers.reserve(batch.size());
+            for (auto &frame: batch)
+                buffers.push_back(frame->buffer());
+            {
+                Trace::Span span("client write", connection->room);
+                co_await boost::asio::async_write(connection->socket, buffers,
+                                                  boost::asio::use_awaitable);
+            }
+            if (!connection->send_queue.empty())
+                connection->send_queue.pop_front();
+        }
+    } catch (std::exception &) {
+        connection->close();
+    }
+    co_return;
+}
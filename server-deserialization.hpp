@@ -1,81 +1,75 @@
+namespace Deserialization {
+    const uint8_t UP = 0;
+    const uint8_t RIGHT = 1;
+    const uint8_t DOWN = 2;
+    const uint8_t LEFT = 3;
 
-namespace Serialization {
-    void serialize(uint8_t number, boost::asio::streambuf &streambuf) {
-        streambuf.sputn((const char *) &number, sizeof(number));
-    }
+    using ClientMessage = std::variant<Message::ReceiveJoinMessage,
+            Message::ReceivePlaceBombMessage,
+            Message::ReceivePlaceBlockMessage,
+            Message::ReceiveMoveMessage>;
 
-    void serialize(uint16_t number, boost::asio::streambuf &streambuf) {
-        uint16_t number_be = htons(number);
-        streambuf.sputn((const char *) &number_be, sizeof(number_be));
-    }
+    struct InvalidMessage : std::runtime_error {
+        InvalidMessage(const std::string &what) : std::runtime_error(what) {}
+    };
 
-    void serialize(uint32_t number, boost::asio::streambuf &streambuf) {
-        uint32_t number_be = htonl(number);
-        streambuf.sputn((const char *) &number_be, sizeof(number_be));
-    }
+    // Per-connection read buffer. receive() takes as many bytes as the kernel has in one read,
+    // next() then cuts complete messages out of them one by one, without touching the socket.
+    // Bytes of a message which hasn't fully arrived yet wait in the buffer for the next read.
+    struct MessageReader {
+        // Longest client message is Join with a 255 characters long name.
+        static constexpr size_t MAX_MESSAGE_SIZE = Protocol::Join::min_size + UINT8_MAX;
+        static constexpr size_t BUFFER_SIZE = 4096;
 
-    void serialize(std::string &str, boost::asio::streambuf &streambuf) {
-        uint8_t length = (uint8_t) str.size();
-        serialize(length, streambuf);
-        streambuf.sputn((const char *) str.data(), length);
-    }
+        char data[BUFFER_SIZE];
+        size_t begin = 0;
+        size_t end = 0;
 
-    void serialize(Position &position, boost::asio::streambuf &streambuf) {
-        serialize(position.x, streambuf);
-        serialize(position.y, streambuf);
-    }
-
-    void serialize_hello_message(boost::asio::streambuf &streambuf, GameInfo &game_info) {
-        serialize(HELLO_MESSAGE_CODE, streambuf);
-        serialize(game_info.server_name, streambuf);
-        serialize(game_info.players_count, streambuf);
-        serialize(game_info.board_dimensions.size_x, streambuf);
-        serialize(game_info.board_dimensions.size_y, streambuf);
-        serialize(game_info.game_length, streambuf);
-        serialize(game_info.explosion_radius, streambuf);
-        serialize(game_info.bomb_timer, streambuf);
-    }
-
-    void serialize_accepted_player_message(boost::asio::streambuf &streambuf, player_id_t &id,
-                                           Player &player) {
-        serialize(ACCEPTED_PLAYER_MESSAGE_CODE, streambuf);
-        serialize(id, streambuf);
-        serialize(player.name, streambuf);
-        std::string full_address =
-                player.address.host + player.address.delimiter + player.address.port;
-        serialize(full_address, streambuf);
-    }
-
-    void serialize_game_started_message(boost::asio::streambuf &streambuf, PlayersMap &players) {
-        serialize(GAME_STARTED_MESSAGE_CODE, streambuf);
-        serialize((uint32_t) players.size(), streambuf);
-        for (auto &p: players) {
-            serialize(p.first, streambuf);
-            serialize(p.second.name, streambuf);
-            std::string full_address =
-                    p.second.address.host + p.second.address.delimiter + p.second.address.port;
-            serialize(full_address, streambuf);
-        }
-    }
-
-    void serialize_turn_message(boost::asio::streambuf &streambuf, Turn &turn) {
-        serialize(TURN_MESSAGE_CODE, streambuf);
-        serialize(turn.nr, streambuf);
-        serialize((uint32_t) (turn.events.size() + turn.explosions.size()), streambuf);
-        for (auto &event : turn.explosions) {
-            event.second->get_serialized(streambuf);
-        }
-        for (auto &event: turn.events) {
-            event.second->get_serialized(streambuf);
+        boost::asio::awaitable<void> receive(boost::asio::ip::tcp::socket &socket) {
+            if (begin == end) {
+                begin = end = 0;
+            } else if (BUFFER_SIZE - begin < MAX_MESSAGE_SIZE) {
+                // Niepełna wiadomość na końcu bufora - przesuń ją na początek.
+                std::memmove(data, data + begin, end - begin);
+                end -= begin;
+                begin = 0;
+            }
+            end += co_await socket.async_read_some(
+                    boost::asio::buffer(data + end, BUFFER_SIZE - end),
+                    boost::asio::use_awaitable);
         }
-    }
 
-    void serialize_game_ended_message(boost::asio::streambuf &streambuf, PlayerScoreMap &scores) {
-        serialize(GAME_ENDED_MESSAGE_CODE, streambuf);
-        serialize((uint32_t) scores.size(), streambuf);
-        for (auto &player_score: scores) {
-            serialize(player_score.first, streambuf);
-            serialize(player_score.second, streambuf);
+        // Next complete message from the buffer, nullopt if it hasn't fully arrived yet.
+        // Messages carry player_id, the id of the sender known at the moment of parsing.
+        std::optional <ClientMessage> next(player_id_t player_id) {
+            Reader reader(data + begin, end - begin);
+            if (!reader.has(1))
+                return std::nullopt;
+            uint8_t code = reader.u8();
+            // Tylko sprawdzenie, czy cała wiadomość już doszła, dekodowana jest dopiero wtedy.
+            Reader probe = reader;
+            if (code == Protocol::Join::code && !Protocol::Join::skip_body(probe))
+                return std::nullopt;
+            if (code == Protocol::Move::code && !Protocol::Move::skip_body(probe))
+                return std::nullopt;
+            std::optional <ClientMessage> message;
+            if (code == Protocol::Join::code) {
+                auto [name] = Protocol::Join::read_body(reader);
+                message = Message::ReceiveJoinMessage(std::string(name));
+            } else if (code == Protocol::PlaceBomb::code) {
+                message = Message::ReceivePlaceBombMessage(player_id);
+            } else if (code == Protocol::PlaceBlock::code) {
+                message = Message::ReceivePlaceBlockMessage(player_id);
+            } else if (code == Protocol::Move::code) {
+                auto [direction] = Protocol::Move::read_body(reader);
+                if (direction > LEFT)
+                    throw InvalidMessage("invalid move direction");
+                message = Message::ReceiveMoveMessage(player_id, direction);
+            } else {
+                throw InvalidMessage("invalid message code");
+            }
+            begin += reader.index;
+            return message;
         }
-    }
+    };
 }
@@ -0,0 +1,170 @@
+// Rules of the game over GameInfo, without any sockets, timers or output. The server drives it
+// from the turn loop, the benchmark drives it with scripted players as fast as it can.
+//
+// A game goes: start_game(), then play_turn() for turns 0..game_length with the players'
+// actions (place_bomb, place_block, move) coming in between, next_turn() after every turn but
+// the last one, and end_game().
+struct Engine {
+    GameInfo &game_info;
+
+    Engine(GameInfo &game_info) : game_info(game_info) {};
+
+    void start_game() {
+        game_info.game_started_to_be_sent = false;
+        game_info.is_running = true;
+        game_info.current_turn = 0;
+    }
+
+    // Actions of players who aren't in the current game, e.g. still holding an id from
+    // the previous one, are ignored.
+    bool accepts_actions_of(player_id_t player_id) {
+        return game_info.accepting_moves() && game_info.player_position_map.count(player_id);
+    }
+
+    void place_bomb(player_id_t player_id) {
+        if (!accepts_actions_of(player_id))
+            return;
+        Event::BombPlaced event(game_info.total_bomb_placed_count++,
+                                game_info.player_position_map[player_id]);
+        game_info.turn_working_list.back().set_player_event(player_id, event);
+    }
+
+    void place_block(player_id_t player_id) {
+        if (!accepts_actions_of(player_id))
+            return;
+        Event::BlockPlaced event(game_info.player_position_map[player_id]);
+        game_info.turn_working_list.back().set_player_event(player_id, event);
+    }
+
+    void move(player_id_t player_id, uint8_t direction) {
+        if (!accepts_actions_of(player_id))
+            return;
+        Position &position = game_info.player_position_map[player_id];
+        std::optional <Position> potential_position = get_potential_new_position(position,
+                                                                                 direction);
+        if (potential_position) {
+            Event::PlayerMoved event(player_id, potential_position.value());
+            game_info.turn_working_list.back().set_player_event(player_id, event);
+        }
+    }
+
+    std::optional <Position>
+    get_potential_new_position(Position &position, uint8_t direction) {
+        Position potential(position.x, position.y);
+        if (direction == Deserialization::UP) {
+            if (position.y == game_info.board_dimensions.size_y - 1)
+                return std::nullopt;
+            potential.y++;
+        } else if (direction == Deserialization::RIGHT) {
+            if (position.x == game_info.board_dimensions.size_x - 1)
+                return std::nullopt;
+            potential.x++;
+        } else if (direction == Deserialization::DOWN) {
+            if (position.y == 0)
+                return std::nullopt;
+            potential.y--;
+        } else if (direction == Deserialization::LEFT) {
+            if (position.x == 0)
+                return std::nullopt;
+            potential.x--;
+        }
+        if (game_info.blocks.test(potential.x, potential.y))
+            return std::nullopt;
+        return potential;
+    }
+
+    void prepare_board() {
+        if (game_info.current_turn > 0)
+            return;
+        for (player_id_t i = 0; i < game_info.players_count; ++i) {
+            Position position((uint16_t) game_info.random_number_generator.generate() %
+                              game_info.board_dimensions.size_x,
+                              (uint16_t) game_info.random_number_generator.generate() %
+                              game_info.board_dimensions.size_y);
+
+            game_info.player_position_map[i] = position;
+            game_info.player_score_map[i] = 0;
+            // dodaj zdarzenie PlayerMoved do listy
+            Event::PlayerMoved event(i, position);
+            game_info.turn_official_list.back().add_event(event);
+        }
+
+        for (uint16_t i = 0; i < game_info.initial_blocks; ++i) {
+            Position position;
+            position.x = (uint16_t) game_info.random_number_generator.generate() %
+                         game_info.board_dimensions.size_x;
+            position.y = (uint16_t) game_info.random_number_generator.generate() %
+                         game_info.board_dimensions.size_y;
+            game_info.blocks.insert(position);
+            Event::BlockPlaced event(position);
+            game_info.turn_official_list.back().add_event(event);
+        }
+    }
+
+    Event::BombExploded do_bomb_exploded(uint32_t bomb_id, Bomb &bomb) {
+        Event::BombExploded event;
+        event.id = bomb_id;
+        // First find where the bomb explodes.
+        event.calc_explosion(game_info, bomb);
+        // Find robots and blocks standing on positions where the explosion is taking place.
+        event.create_blocks_destroyed_list(game_info.blocks);
+        event.create_robots_destroyed_list(game_info.player_occupancy);
+        return event;
+    }
+
+    void update_game_info_with_turn_events() {
+        // Tylko bomby, które wybuchają w tej turze, w kolejności identyfikatorów.
+        std::vector <bomb_id_t> &exploding = game_info.bombs_exploding_in(game_info.current_turn);
+        std::sort(exploding.begin(), exploding.end());
+        if (!exploding.empty())
+            game_info.player_occupancy.build(game_info.player_position_map);
+        Turn &turn = game_info.turn_official_list.back();
+        for (bomb_id_t bomb_id: exploding)
+            turn.explosions.push_back(do_bomb_exploded(bomb_id, game_info.bomb_map[bomb_id]));
+        exploding.clear();
+        auto update = [this](auto &event) { event.update_game_info(game_info); };
+        for (auto &explosion: turn.explosions)
+            std::visit(update, explosion);
+        // Ruchy graczy zniszczonych w tej turze zostały już zastąpione ich odrodzeniem.
+        for (auto &event: turn.events)
+            std::visit(update, event);
+    }
+
+    // Plays the current turn: turn 0 sets the board up, every later one applies the actions
+    // collected since the previous turn. Returns the turn with all its events.
+    Turn &play_turn() {
+        if (game_info.current_turn == 0) {
+            game_info.turn_working_list.push_back(Turn(game_info.current_turn));
+            game_info.turn_official_list.push_back(Turn(game_info.current_turn));
+            prepare_board();
+        } else {
+            game_info.turn_official_list.back() = game_info.turn_working_list.back();
+        }
+        update_game_info_with_turn_events();
+        return game_info.turn_official_list.back();
+    }
+
+    void next_turn() {
+        game_info.current_turn++;
+        game_info.turn_working_list.push_back(Turn(game_info.current_turn));
+        game_info.turn_official_list.push_back(Turn(game_info.current_turn));
+    }
+
+    // Back to the lobby. The random number generator keeps its state between games.
+    void end_game() {
+        game_info.is_running = false;
+        game_info.game_started_to_be_sent = false;
+        game_info.current_turn = 0;
+        game_info.player_position_map.clear();
+        game_info.player_score_map.clear();
+        game_info.players.clear();
+        game_info.players_working.clear();
+        game_info.turn_working_list.clear();
+        game_info.turn_official_list.clear();
+        game_info.bomb_map.clear();
+        for (auto &bucket: game_info.bomb_wheel)
+            bucket.clear();
+        game_info.blocks.clear();
+        game_info.total_bomb_placed_count = 0;
+    }
+};
@@ -0,0 +1,86 @@
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Server health in the Prometheus text exposition format, served over HTTP on a local port.
+// Everything here is updated with atomics from any thread, rendering only reads them.
+namespace Metrics {
+    // HDR-style histogram with log-linear buckets: two per power of two (1, 1.5, 2, 3, 4, 6, ...)
+    // times the unit, so the relative error stays under a half over the whole range, with a fixed
+    // number of buckets and no allocation when observing.
+    struct Histogram {
+        std::string name;
+        std::string help;
+        std::vector<double> bounds;
+        std::unique_ptr<std::atomic<uint64_t>[]> counts;
+        std::atomic<double> sum{0};
+        std::atomic <uint64_t> count{0};
+
+        Histogram(std::string name, std::string help, double unit, uint32_t powers) :
+                name(std::move(name)), help(std::move(help)) {
+            for (uint32_t power = 0; power < powers; ++power) {
+                bounds.push_back(unit * std::ldexp(1.0, (int) power));
+                bounds.push_back(unit * std::ldexp(1.5, (int) power));
+            }
+            // Ostatni kubełek to +Inf.
+            counts = std::make_unique<std::atomic<uint64_t>[]>(bounds.size() + 1);
+        }
+
+        void observe(double value) {
+            size_t bucket = (size_t) (std::lower_bound(bounds.begin(), bounds.end(), value) -
+                                      bounds.begin());
+            counts[bucket].fetch_add(1, std::memory_order_relaxed);
+            sum.fetch_add(value, std::memory_order_relaxed);
+            count.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        void render(std::ostream &out) const {
+            out << "# HELP " << name << " " << help << "\n# TYPE " << name << " histogram\n";
+            uint64_t cumulative = 0;
+            for (size_t i = 0; i < bounds.size(); ++i) {
+                cumulative += counts[i].load(std::memory_order_relaxed);
+                out << name << "_bucket{le=\"" << bounds[i] << "\"} " << cumulative << "\n";
+            }
+            cumulative += counts[bounds.size()].load(std::memory_order_relaxed);
+            out << name << "_bucket{le=\"+Inf\"} " << cumulative << "\n"
+                << name << "_sum " << sum.load(std::memory_order_relaxed) << "\n"
+                << name << "_count " << count.load(std::memory_order_relaxed) << "\n";
+        }
+    };
+
+    struct Metrics {
+        // 1 us .. ~16 s
+        Histogram tick_duration{"robots_tick_duration_seconds",
+                                "Time spent on a single room tick.", 1e-6, 24};
+        Histogram tick_overrun{"robots_tick_overrun_seconds",
+                               "How late a room tick started after its deadline.", 1e-6, 24};
+        // 1 B .. ~1 GB
+        Histogram turn_bytes_sent{"robots_turn_bytes_sent",
+                                  "Bytes of a Turn message times the clients it went to.", 1, 30};
+        // 1 .. ~512
+        Histogram send_queue_depth{"robots_send_queue_depth",
+                                   "Batches waiting in a client's send queue after enqueueing.",
+                                   1, 10};
+        std::atomic <uint64_t> messages_parsed{0};
+        std::atomic <int64_t> connected_sockets{0};
+
+        void render(std::ostream &out) const {
+            tick_duration.render(out);
+            tick_overrun.render(out);
+            turn_bytes_sent.render(out);
+            send_queue_depth.render(out);
+            out << "# HELP robots_client_messages_parsed_total Messages parsed from clients.\n"
+                << "# TYPE robots_client_messages_parsed_total counter\n"
+                << "robots_client_messages_parsed_total " << messages_parsed << "\n"
+                << "# HELP robots_connected_sockets Open client connections.\n"
+                << "# TYPE robots_connected_sockets gauge\n"
+                << "robots_connected_sockets " << connected_sockets << "\n";
+        }
+    };
+
+    Metrics metrics;
+}
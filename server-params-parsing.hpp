@@ -15,6 +15,7 @@
 #include <boost/spirit/home/x3.hpp>
 #include <boost/spirit/include/qi.hpp>
 #include <boost/spirit/include/qi_string.hpp>
+#include <algorithm>
 #include <cstdlib>
 #include <exception>
 #include <iostream>
@@ -38,6 +39,11 @@ namespace ServerProgramParams {
                 std::cerr << "Players count number is too large.";
                 exit(1);
             }
+            // Bomba musi wybuchnąć w którejś z kolejnych tur, nie w tej, w której ją położono.
+            if (bomb_timer == 0) {
+                std::cerr << "Bomb timer has to be at least 1.\n";
+                exit(1);
+            }
         };
 
         uint16_t bomb_timer;
@@ -51,6 +57,14 @@ namespace ServerProgramParams {
         uint16_t size_x;
         uint16_t size_y;
         uint32_t seed;
+        // Co ile tur robić zrzut stanu gry dla spóźnionych klientów, 0 - wyłączone.
+        uint16_t snapshot_interval = 0;
+        // Liczba wątków obsługujących io_context.
+        uint16_t threads = 1;
+        // Plik, do którego zapisywany jest ślad faz tur, puste - bez śledzenia.
+        std::string trace_file;
+        // Port lokalnej strony z metrykami, 0 - wyłączona.
+        uint16_t metrics_port = 0;
     };
 
     bool help_provided(boost::program_options::variables_map &vm) {
@@ -96,6 +110,18 @@ namespace ServerProgramParams {
         }
     }
 
+    void set_optional_params(ServerProgramParams &params,
+                             boost::program_options::variables_map &vm) {
+        if (vm.count("snapshot-interval"))
+            params.snapshot_interval = vm["snapshot-interval"].as<uint16_t>();
+        if (vm.count("threads"))
+            params.threads = std::max<uint16_t>(vm["threads"].as<uint16_t>(), 1);
+        if (vm.count("trace-file"))
+            params.trace_file = vm["trace-file"].as<std::string>();
+        if (vm.count("metrics-port"))
+            params.metrics_port = vm["metrics-port"].as<uint16_t>();
+    }
+
     ServerProgramParams parse_program_params(int argc, char **av) {
         boost::program_options::options_description desc("Allowed options");
         desc.add_options()
@@ -111,7 +137,18 @@ namespace ServerProgramParams {
                 ("port,p", boost::program_options::value<uint16_t>(), "port")
                 ("seed,s", boost::program_options::value<uint32_t>(), "seed")
                 ("size-x,x", boost::program_options::value<uint16_t>(), "size-x")
-                ("size-y,y", boost::program_options::value<uint16_t>(), "size-y");
+                ("size-y,y", boost::program_options::value<uint16_t>(), "size-y")
+                ("snapshot-interval", boost::program_options::value<uint16_t>(),
+                 "send late joiners a game state snapshot taken every this many turns "
+                 "instead of all the turns (requires clients supporting it)")
+                ("threads", boost::program_options::value<uint16_t>(),
+                 "number of threads handling client connections (default 1), "
+                 "the game itself is always simulated on a single strand")
+                ("trace-file", boost::program_options::value<std::string>(),
+                 "record timings of every tick phase and client read/write, written to this "
+                 "file in Chrome trace format at the end of every game and on SIGUSR1")
+                ("metrics-port", boost::program_options::value<uint16_t>(),
+                 "serve metrics in Prometheus text format over HTTP on this port of localhost");
 
         boost::program_options::variables_map vm;
         boost::program_options::store(boost::program_options::parse_command_line(argc, av, desc),
@@ -126,6 +163,8 @@ namespace ServerProgramParams {
             std::cerr << desc << "\n";
             exit(1);
         }
-        return get_server_program_params(vm);
+        ServerProgramParams params = get_server_program_params(vm);
+        set_optional_params(params, vm);
+        return params;
     }
 }
@@ -1,81 +1,68 @@
-
 namespace Serialization {
-    void serialize(uint8_t number, boost::asio::streambuf &streambuf) {
-        streambuf.sputn((const char *) &number, sizeof(number));
-    }
-
-    void serialize(uint16_t number, boost::asio::streambuf &streambuf) {
-        uint16_t number_be = htons(number);
-        streambuf.sputn((const char *) &number_be, sizeof(number_be));
+    // Every message is encoded by a Writer into a buffer of exactly its size.
+    FramePtr make_frame(Writer &writer) {
+        return std::make_shared<const Frame>(std::move(writer.finish()));
     }
 
-    void serialize(uint32_t number, boost::asio::streambuf &streambuf) {
-        uint32_t number_be = htonl(number);
-        streambuf.sputn((const char *) &number_be, sizeof(number_be));
+    std::string full_address(const Player &player) {
+        return player.address.host + player.address.delimiter + player.address.port;
     }
 
-    void serialize(std::string &str, boost::asio::streambuf &streambuf) {
-        uint8_t length = (uint8_t) str.size();
-        serialize(length, streambuf);
-        streambuf.sputn((const char *) str.data(), length);
+    FramePtr serialize_hello_message(GameInfo &game_info) {
+        Writer writer = Protocol::Hello::encode(game_info.server_name, game_info.players_count,
+                                                game_info.board_dimensions.size_x,
+                                                game_info.board_dimensions.size_y,
+                                                game_info.game_length, game_info.explosion_radius,
+                                                game_info.bomb_timer);
+        return make_frame(writer);
     }
 
-    void serialize(Position &position, boost::asio::streambuf &streambuf) {
-        serialize(position.x, streambuf);
-        serialize(position.y, streambuf);
+    FramePtr serialize_accepted_player_message(player_id_t &id, Player &player) {
+        Writer writer = Protocol::AcceptedPlayer::encode(id, player.name, full_address(player));
+        return make_frame(writer);
     }
 
-    void serialize_hello_message(boost::asio::streambuf &streambuf, GameInfo &game_info) {
-        serialize(HELLO_MESSAGE_CODE, streambuf);
-        serialize(game_info.server_name, streambuf);
-        serialize(game_info.players_count, streambuf);
-        serialize(game_info.board_dimensions.size_x, streambuf);
-        serialize(game_info.board_dimensions.size_y, streambuf);
-        serialize(game_info.game_length, streambuf);
-        serialize(game_info.explosion_radius, streambuf);
-        serialize(game_info.bomb_timer, streambuf);
+    FramePtr serialize_game_started_message(PlayersMap &players) {
+        auto player_entry = [](auto &p) {
+            return std::tuple<player_id_t, const std::string &, std::string>(
+                    p.first, p.second.name, full_address(p.second));
+        };
+        Writer writer = Protocol::GameStarted::encode(Protocol::mapped(players, player_entry));
+        return make_frame(writer);
     }
 
-    void serialize_accepted_player_message(boost::asio::streambuf &streambuf, player_id_t &id,
-                                           Player &player) {
-        serialize(ACCEPTED_PLAYER_MESSAGE_CODE, streambuf);
-        serialize(id, streambuf);
-        serialize(player.name, streambuf);
-        std::string full_address =
-                player.address.host + player.address.delimiter + player.address.port;
-        serialize(full_address, streambuf);
-    }
+    FramePtr serialize_turn_message(Turn &turn) {
+        size_t size = Protocol::TurnHeader::min_size;
+        auto add_size = [&size](auto &event) { size += event.encoded_size(); };
+        for (auto &event: turn.explosions)
+            std::visit(add_size, event);
+        for (auto &event: turn.events)
+            std::visit(add_size, event);
 
-    void serialize_game_started_message(boost::asio::streambuf &streambuf, PlayersMap &players) {
-        serialize(GAME_STARTED_MESSAGE_CODE, streambuf);
-        serialize((uint32_t) players.size(), streambuf);
-        for (auto &p: players) {
-            serialize(p.first, streambuf);
-            serialize(p.second.name, streambuf);
-            std::string full_address =
-                    p.second.address.host + p.second.address.delimiter + p.second.address.port;
-            serialize(full_address, streambuf);
-        }
+        Writer writer(size);
+        Protocol::TurnHeader::write(writer, turn.nr, turn.events_count());
+        auto serialize_event = [&writer](auto &event) { event.get_serialized(writer); };
+        for (auto &event: turn.explosions)
+            std::visit(serialize_event, event);
+        for (auto &event: turn.events)
+            std::visit(serialize_event, event);
+        return make_frame(writer);
     }
 
-    void serialize_turn_message(boost::asio::streambuf &streambuf, Turn &turn) {
-        serialize(TURN_MESSAGE_CODE, streambuf);
-        serialize(turn.nr, streambuf);
-        serialize((uint32_t) (turn.events.size() + turn.explosions.size()), streambuf);
-        for (auto &event : turn.explosions) {
-            event.second->get_serialized(streambuf);
-        }
-        for (auto &event: turn.events) {
-            event.second->get_serialized(streambuf);
-        }
+    FramePtr serialize_snapshot_message(GameInfo &game_info) {
+        auto bomb_entry = [&game_info](auto &bomb) {
+            return std::make_tuple(bomb.first, bomb.second.position,
+                                   game_info.bomb_timer_left(bomb.second));
+        };
+        Writer writer = Protocol::Snapshot::encode(game_info.current_turn,
+                                                   game_info.player_position_map,
+                                                   game_info.player_score_map, game_info.blocks,
+                                                   Protocol::mapped(game_info.bomb_map, bomb_entry));
+        return make_frame(writer);
     }
 
-    void serialize_game_ended_message(boost::asio::streambuf &streambuf, PlayerScoreMap &scores) {
-        serialize(GAME_ENDED_MESSAGE_CODE, streambuf);
-        serialize((uint32_t) scores.size(), streambuf);
-        for (auto &player_score: scores) {
-            serialize(player_score.first, streambuf);
-            serialize(player_score.second, streambuf);
-        }
+    FramePtr serialize_game_ended_message(PlayerScoreMap &scores) {
+        Writer writer = Protocol::GameEnded::encode(scores);
+        return make_frame(writer);
     }
 }
@@ -0,0 +1,47 @@
+// Wakes the turn loop up on a fixed cadence. Deadlines are absolute, each one exactly one period
+// after the previous deadline, so the time spent simulating and sending a turn doesn't push
+// the following turns back.
+struct TickScheduler {
+    using clock = std::chrono::steady_clock;
+
+    boost::asio::steady_timer timer;
+    clock::duration period;
+    clock::time_point started;
+    clock::time_point next_deadline;
+    uint64_t ticks = 0;
+    // Ticks which started late because the previous one didn't fit in its period.
+    uint64_t overruns = 0;
+    clock::duration max_overrun = clock::duration::zero();
+    // How late after its deadline the last tick actually started.
+    clock::duration lateness = clock::duration::zero();
+
+    template<typename Executor>
+    TickScheduler(const Executor &executor, clock::duration period) : timer(executor),
+                                                                      period(period) {}
+
+    boost::asio::awaitable<void> wait() {
+        clock::time_point now = clock::now();
+        if (ticks == 0) {
+            started = now;
+            next_deadline = now;
+        }
+        next_deadline += period;
+        if (now > next_deadline) {
+            overruns++;
+            max_overrun = std::max(max_overrun, now - next_deadline);
+            // Ponad okres spóźnienia - nie nadrabiamy zaległych tur seriami, tylko zaczynamy od teraz.
+            if (now - next_deadline >= period)
+                next_deadline = now;
+        }
+        timer.expires_at(next_deadline);
+        co_await timer.async_wait(boost::asio::use_awaitable);
+        lateness = std::max(clock::duration::zero(), clock::now() - next_deadline);
+        ticks++;
+    }
+
+    // Ticks per second achieved so far.
+    double tick_rate() const {
+        double seconds = std::chrono::duration<double>(clock::now() - started).count();
+        return seconds > 0 ? (double) ticks / seconds : 0;
+    }
+};
@@ -0,0 +1,173 @@
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <mutex>
+#include <thread>
+
+// Timings of the phases of every tick and of the clients' reads and writes, for finding out
+// where an overrun came from. A Span measures the scope it lives in and records it into a ring
+// buffer shared by all the threads, keeping the latest CAPACITY spans. dump() writes them out
+// in the Chrome trace format (chrome://tracing, ui.perfetto.dev): one process per room, one row
+// per thread. Tracing is off unless a trace file was given, a Span then costs a single branch.
+namespace Trace {
+    using clock = std::chrono::steady_clock;
+
+    struct Tracer {
+        static constexpr size_t CAPACITY = 1 << 16;
+
+        // Span in a slot of the ring. Fields are written and read without locks, sequence tells
+        // the reader which span the slot holds, 0 while it's being written.
+        struct Slot {
+            std::atomic <uint64_t> sequence{0};
+            std::atomic<const char *> name{nullptr};
+            std::atomic <uint32_t> room{0};
+            std::atomic <uint32_t> thread{0};
+            std::atomic <int64_t> start{0};
+            std::atomic <int64_t> duration{0};
+        };
+
+        std::atomic<bool> enabled{false};
+        std::string file;
+        clock::time_point origin = clock::now();
+        std::atomic <uint64_t> head{0};
+        std::unique_ptr<Slot[]> slots;
+        std::atomic <uint32_t> threads{0};
+        std::mutex dump_mutex;
+        // Thread writing the dumps asked for with dump_later(), runs while tracing is on.
+        std::thread writer;
+        std::mutex request_mutex;
+        std::condition_variable request_ready;
+        bool dump_requested = false;
+        bool stopping = false;
+
+        void enable(const std::string &trace_file) {
+            file = trace_file;
+            if (!file.empty())
+                slots = std::make_unique<Slot[]>(CAPACITY);
+            enabled = !file.empty();
+            if (enabled)
+                writer = std::thread([this] { write_requested_dumps(); });
+        }
+
+        ~Tracer() {
+            if (!writer.joinable())
+                return;
+            {
+                std::lock_guard <std::mutex> lock(request_mutex);
+                stopping = true;
+            }
+            request_ready.notify_one();
+            writer.join();
+        }
+
+        // dump() on the writer thread, for callers which mustn't wait for the file, like a game
+        // strand. Requests coming while a dump is being written are served with a single one.
+        void dump_later() {
+            if (!enabled)
+                return;
+            {
+                std::lock_guard <std::mutex> lock(request_mutex);
+                dump_requested = true;
+            }
+            request_ready.notify_one();
+        }
+
+        // Small number of the calling thread, stable for its lifetime.
+        uint32_t thread_number() {
+            thread_local uint32_t number = threads++;
+            return number;
+        }
+
+        void record(const char *name, uint32_t room, uint32_t thread, clock::time_point start,
+                    clock::time_point end) {
+            uint64_t index = head.fetch_add(1, std::memory_order_relaxed);
+            Slot &slot = slots[index % CAPACITY];
+            slot.sequence.store(0, std::memory_order_relaxed);
+            // Release na polach - czytelnik, który zobaczy którekolwiek z nich, zobaczy też 0.
+            slot.name.store(name, std::memory_order_release);
+            slot.room.store(room, std::memory_order_release);
+            slot.thread.store(thread, std::memory_order_release);
+            slot.start.store((start - origin).count(), std::memory_order_release);
+            slot.duration.store((end - start).count(), std::memory_order_release);
+            slot.sequence.store(index + 1, std::memory_order_release);
+        }
+
+        // Writes out the spans currently in the ring, slots being overwritten are skipped.
+        void dump() {
+            if (!enabled)
+                return;
+            std::lock_guard <std::mutex> lock(dump_mutex);
+            std::ofstream out(file, std::ios::trunc);
+            if (!out) {
+                std::cerr << "cannot write trace to " << file << "\n";
+                return;
+            }
+            out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+            bool first = true;
+            uint64_t end = head.load(std::memory_order_acquire);
+            uint64_t begin = end > CAPACITY ? end - CAPACITY : 0;
+            for (uint64_t index = begin; index < end; ++index) {
+                Slot &slot = slots[index % CAPACITY];
+                uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+                const char *name = slot.name.load(std::memory_order_acquire);
+                uint32_t room = slot.room.load(std::memory_order_acquire);
+                uint32_t thread = slot.thread.load(std::memory_order_acquire);
+                int64_t start = slot.start.load(std::memory_order_acquire);
+                int64_t duration = slot.duration.load(std::memory_order_acquire);
+                // Keeps the second look at sequence from being done before the fields are read.
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (sequence != index + 1 || slot.sequence.load(std::memory_order_relaxed) != sequence)
+                    continue;
+                out << (first ? "" : ",") << "\n{\"name\":\"" << name
+                    << "\",\"ph\":\"X\",\"pid\":" << room << ",\"tid\":" << thread
+                    << ",\"ts\":" << std::chrono::duration<double, std::micro>(
+                            clock::duration(start)).count()
+                    << ",\"dur\":" << std::chrono::duration<double, std::micro>(
+                            clock::duration(duration)).count() << "}";
+                first = false;
+            }
+            out << "\n]}\n";
+            std::cout << "trace of " << end - begin << " spans written to " << file << "\n";
+        }
+
+    private:
+        void write_requested_dumps() {
+            std::unique_lock <std::mutex> lock(request_mutex);
+            for (;;) {
+                request_ready.wait(lock, [this] { return dump_requested || stopping; });
+                if (!dump_requested)
+                    return;
+                dump_requested = false;
+                lock.unlock();
+                dump();
+                lock.lock();
+            }
+        }
+    };
+
+    Tracer tracer;
+
+    // Measures its own lifetime. Name has to be a string literal.
+    struct Span {
+        const char *name;
+        uint32_t room;
+        uint32_t thread = 0;
+        clock::time_point start;
+
+        Span(const char *name, size_t room) : name(name), room((uint32_t) room) {
+            if (tracer.enabled) {
+                thread = tracer.thread_number();
+                start = clock::now();
+            }
+        }
+
+        ~Span() {
+            if (tracer.enabled)
+                tracer.record(name, room, thread, start, clock::now());
+        }
+
+        Span(const Span &) = delete;
+        Span &operator=(const Span &) = delete;
+    };
+}
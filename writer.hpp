@@ -0,0 +1,61 @@
+#include <arpa/inet.h>
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Message encoder writing big-endian fields straight into a buffer allocated once for the whole
+// message. The exact encoded size has to be known up front, it's checked when the message ends.
+struct Writer {
+    std::vector<char> bytes;
+    size_t index = 0;
+
+    explicit Writer(size_t size) : bytes(size) {}
+
+    static size_t string_size(std::string_view str) {
+        return 1 + std::min<size_t>(str.size(), UINT8_MAX);
+    }
+
+    void u8(uint8_t number) {
+        assert(index + sizeof(number) <= bytes.size());
+        bytes[index++] = (char) number;
+    }
+
+    void u16(uint16_t number) {
+        uint16_t number_be = htons(number);
+        put(&number_be, sizeof(number_be));
+    }
+
+    void u32(uint32_t number) {
+        uint32_t number_be = htonl(number);
+        put(&number_be, sizeof(number_be));
+    }
+
+    void string(std::string_view str) {
+        uint8_t length = (uint8_t) std::min<size_t>(str.size(), UINT8_MAX);
+        u8(length);
+        put(str.data(), length);
+    }
+
+    template<typename P>
+    void position(const P &position) {
+        u16(position.x);
+        u16(position.y);
+    }
+
+    // The buffer after checking the message took exactly the announced size.
+    std::vector<char> &finish() {
+        assert(index == bytes.size());
+        return bytes;
+    }
+
+private:
+    void put(const void *data, size_t size) {
+        assert(index + size <= bytes.size());
+        memcpy(bytes.data() + index, data, size);
+        index += size;
+    }
+};